@@ -0,0 +1,257 @@
+// benchmarks of the hot paths of lexer, parser and evaluator
+//
+// usage: monkey_bench [--json] [--reps N] [--warmup N] [--filter NAME] [--size N]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "harness.hpp"
+#include "lexer/lexer.hpp"
+#include "lexer/stream_lexer.hpp"
+#include "parser/parser.hpp"
+#include "parser/parallel.hpp"
+#include "ast/flat.hpp"
+#include "eval/eval.hpp"
+#include "vm/machine.hpp"
+#include "eval/closure.hpp"
+
+std::atomic<std::size_t> bench::allocations{0};
+
+// count every heap allocation of the process
+void* operator new(std::size_t n)
+{
+	++bench::allocations;
+	if (auto* p = std::malloc(n ? n : 1)) return p;
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// identifiers are letters only
+static std::string name(int i)
+{
+	std::string s;
+	do {
+		s += static_cast<char>('a' + i % 26);
+		i /= 26;
+	} while (i);
+	return s;
+}
+
+// a machine-generated looking script, roughly `n` statements
+static std::string make_script(int n)
+{
+	std::string s;
+	for (int i = 0; i < n; ++i) {
+		auto id = std::to_string(i);
+		auto v = "v" + name(i), r = "r" + name(i);
+		s += "let " + v + " = fn(x, y) { if (x < y) { return x * " + id + " + y; } else { return -x / (y - 1); } };\n";
+		s += "let " + r + " = " + v + "(" + id + ", [1, 2, 3][1]) == {\"k\": true}[\"k\"];\n";
+	}
+	return s;
+}
+
+// a library of `n` functions, and a program calling one of them
+static std::string make_library(int n)
+{
+	std::string s;
+	for (int i = 0; i < n; ++i) {
+		auto id = std::to_string(i);
+		s += "let lib" + name(i) + " = fn(x, y) { let h = {\"k\": [x, y]}; if (x < y) { return h[\"k\"][0] * " + id +
+			"; } else { return fn(z) { -z / (y - 1) }(x); } };\n";
+	}
+	return s + "liba(1, 2);\n";
+}
+
+// long identifiers, string bodies and indentation, where the scanning kernels matter
+static std::string make_long_runs(int n)
+{
+	std::string s;
+	for (int i = 0; i < n; ++i) {
+		auto id = "generated_identifier_with_a_long_name_" + name(i);
+		s += "                let " + id + " = \"" + std::string(120, 'x') + "\";\n";
+		s += "                " + id + " + 12345678901234;\n";
+	}
+	return s;
+}
+
+template<class Lexer>
+static std::size_t count_tokens(Lexer& l)
+{
+	std::size_t n = 0;
+	for (auto t = l.next_token(); t.token_type != token::END_OF_FILE; t = l.next_token())
+		++n;
+	return n;
+}
+
+// the classic workloads, a program and the inspect() of its result
+struct workload {
+	const char* name;
+	const char* src;
+	const char* expected;
+};
+
+static const workload workloads[] {
+	{"eval/fib", R"(
+		let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) };
+		fib(20);
+	)", "6765"},
+	{"eval/append", R"(
+		let build = fn(arr, n) { if (n == 0) { return arr; } build(append(arr, n), n - 1) };
+		len(build([], 500));
+	)", "500"},
+	{"eval/hashtable", R"(
+		let h = {"one": 1, "two": 2, 3: 3, true: 4, "five": 5};
+		let loop = fn(n, acc) { if (n == 0) { return acc; } loop(n - 1, acc + h["one"] + h[3] + h[true]) };
+		loop(500, 0);
+	)", "4000"},
+	{"eval/string_concat", R"(
+		let cat = fn(s, n) { if (n == 0) { return s; } cat(s + "xy", n - 1) };
+		len(cat("", 500));
+	)", "1000"},
+	{"eval/closures", R"(
+		let adder = fn(x) { fn(y) { x + y } };
+		let loop = fn(n, acc) { if (n == 0) { return acc; } loop(n - 1, adder(n)(acc)) };
+		loop(500, 0);
+	)", "125250"},
+};
+
+// w on another engine than eval_handler, as <engine>/<workload>
+template<class EvalHandler>
+static bool run_on(bench::runner& r, const char* engine, workload const& w, ast::Program* program)
+{
+	auto res = evaluator::eval<EvalHandler>(program);
+	if (!res || res.inspect() != w.expected) {
+		std::fprintf(stderr, "%s %s: expected %s, got %s\n", engine, w.name, w.expected,
+				res ? res.inspect().c_str() : "nothing");
+		return false;
+	}
+	r.run(engine + std::string(std::strchr(w.name, '/')), 0, "", [&] {
+		evaluator::eval<EvalHandler>(program);
+	});
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	bench::options opt;
+	int size = 20000;
+	for (int i = 1; i < argc; ++i) {
+		auto arg = [&] { return i + 1 < argc ? argv[++i] : (std::exit(64), ""); };
+		if (!std::strcmp(argv[i], "--json")) opt.json = true;
+		else if (!std::strcmp(argv[i], "--reps")) opt.reps = std::atoi(arg());
+		else if (!std::strcmp(argv[i], "--warmup")) opt.warmup = std::atoi(arg());
+		else if (!std::strcmp(argv[i], "--filter")) opt.filter = arg();
+		else if (!std::strcmp(argv[i], "--size")) size = std::atoi(arg());
+		else {
+			std::fprintf(stderr, "usage: %s [--json] [--reps N] [--warmup N] [--filter NAME] [--size N]\n", argv[0]);
+			return 64;
+		}
+	}
+	if (opt.reps < 1) opt.reps = 1;
+
+	bench::runner r(opt);
+	if (!opt.json)
+		std::printf("scan kernels: %s\n", lexer::scan::active().name);
+
+	auto src = make_script(size);
+	auto long_runs = make_long_runs(size);
+	double tokens = [&] { lexer::Lexer l(src, lexer::borrow); return count_tokens(l); }();
+
+	r.run("lex/script", tokens, "tok", [&] {
+		lexer::Lexer l(src, lexer::borrow);
+		count_tokens(l);
+	});
+	r.run("lex/long_runs", long_runs.size(), "B", [&] {
+		lexer::Lexer l(long_runs, lexer::borrow);
+		count_tokens(l);
+	});
+	r.run("lex/stream", tokens, "tok", [&] {
+		std::istringstream in(src);
+		lexer::StreamLexer l(in);
+		count_tokens(l);
+	});
+	r.run("parse/script", tokens, "tok", [&] {
+		parser::Parser<lexer::Lexer> p(new lexer::Lexer(src, lexer::borrow));
+		auto [program, errors] = p.parse();
+		if (!errors.empty()) std::fprintf(stderr, "unexpected parse error: %s\n", errors[0].c_str());
+	});
+	r.run("parse/script_iterative", tokens, "tok", [&] {
+		parser::Parser<lexer::Lexer> p(new lexer::Lexer(src, lexer::borrow), parser::Mode::iterative);
+		auto [program, errors] = p.parse();
+		if (!errors.empty()) std::fprintf(stderr, "unexpected parse error: %s\n", errors[0].c_str());
+	});
+
+	// parse a library and call one function, with eager and lazy bodies
+	{
+		auto library = make_library(size);
+		double library_tokens = [&] { lexer::Lexer l(library, lexer::borrow); return count_tokens(l); }();
+		for (bool lazy: {false, true}) {
+			r.run(lazy ? "first_result/lazy" : "first_result/eager", library_tokens, "tok", [&] {
+				parser::Parser<lexer::Lexer> p(new lexer::Lexer(library, lexer::borrow));
+				p.lazy(lazy);
+				auto program = p.parse().first;
+				evaluator::eval<evaluator::eval_handler>(program.get());
+			});
+		}
+	}
+
+	// the script as 16 files, on 1 worker and on one per hardware thread
+	{
+		std::vector<std::string> files(16, make_script(size / 16));
+		std::vector<parser::Source> sources;
+		for (auto const& f: files) sources.push_back({"", f});
+		std::vector<unsigned> workers{1};
+		if (auto hw = std::thread::hardware_concurrency(); hw > 1) workers.push_back(hw);
+		for (auto w: workers) {
+			r.run("parse/files_" + std::to_string(w) + "_workers", tokens, "tok", [&] {
+				parser::parse_all(sources, w);
+			});
+		}
+	}
+
+	{
+		parser::Parser<lexer::Lexer> p(new lexer::Lexer(src, lexer::borrow));
+		auto program = p.parse().first;
+		auto flat = ast::flat::flatten(*program);
+		r.run("flat/flatten", flat.size(), "node", [&] {
+			ast::flat::flatten(*program);
+		});
+		// all the integers of the program, a linear pass over two arrays
+		r.run("flat/scan", flat.size(), "node", [&] {
+			auto v = flat.view();
+			std::int64_t sum = 0;
+			for (std::size_t n = 0; n < v.size(); ++n)
+				if (v.kinds[n] == ast::flat::Kind::integer) sum += v.integer(n);
+			asm volatile("" :: "r"(sum));
+		});
+		r.run("flat/unflatten", flat.size(), "node", [&] {
+			ast::flat::unflatten(flat.view());
+		});
+	}
+
+	for (auto const& w: workloads) {
+		parser::Parser<lexer::Lexer> p(new lexer::Lexer(w.src, lexer::borrow));
+		auto [program, errors] = p.parse();
+		auto res = evaluator::eval<evaluator::eval_handler>(program.get());
+		if (!errors.empty() || !res || res.inspect() != w.expected) {
+			std::fprintf(stderr, "%s: expected %s, got %s\n", w.name, w.expected,
+					res ? res.inspect().c_str() : errors.empty() ? "nothing" : errors[0].c_str());
+			return 1;
+		}
+		r.run(w.name, 0, "", [&] {
+			evaluator::eval<evaluator::eval_handler>(program.get());
+		});
+		// the same on the bytecode vm and closure compiled
+		if (!run_on<vm::machine>(r, "vm", w, program.get())
+				|| !run_on<evaluator::closure_handler>(r, "closure", w, program.get()))
+			return 1;
+	}
+
+	r.finish();
+	return 0;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// A small timing harness: every case runs some warmup iterations, then
+// the timed repetitions, and reports the distribution of them.
+namespace bench {
+
+// incremented by the replaced operator new of the bench executable
+extern std::atomic<std::size_t> allocations;
+
+struct options {
+	int warmup = 2;
+	int reps = 10;
+	bool json = false;
+	// run only the cases whose name contains filter
+	std::string filter;
+};
+
+struct result {
+	std::string name;
+	// items processed by one repetition, such as tokens, 0 if meaningless
+	double items = 0;
+	std::string unit;
+	std::vector<double> seconds;
+	std::size_t allocations = 0;
+
+	double quantile(double q) const
+	{
+		auto s = seconds;
+		std::sort(s.begin(), s.end());
+		auto i = static_cast<std::size_t>(std::ceil(q * s.size()));
+		return s[i ? i - 1 : 0];
+	}
+	double median() const { return quantile(0.5); }
+	double p99() const { return quantile(0.99); }
+	double min() const { return *std::min_element(seconds.begin(), seconds.end()); }
+};
+
+class runner {
+public:
+	explicit runner(options opt): opt_(std::move(opt)) {}
+
+	// f() is a repetition, items/unit describe the throughput of it
+	template<class F>
+	void run(std::string const& name, double items, std::string const& unit, F&& f)
+	{
+		if (name.find(opt_.filter) == std::string::npos) return;
+
+		for (int i = 0; i < opt_.warmup; ++i) f();
+
+		result r{name, items, unit, {}, 0};
+		auto before = allocations.load();
+		for (int i = 0; i < opt_.reps; ++i) {
+			auto beg = std::chrono::steady_clock::now();
+			f();
+			std::chrono::duration<double> d = std::chrono::steady_clock::now() - beg;
+			r.seconds.push_back(d.count());
+		}
+		r.allocations = (allocations - before) / opt_.reps;
+
+		if (!opt_.json) print(r);
+		results_.push_back(std::move(r));
+	}
+
+	void finish() const
+	{
+		if (!opt_.json) return;
+		std::printf("{\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"benchmarks\": [", opt_.warmup, opt_.reps);
+		for (std::size_t i = 0; i < results_.size(); ++i) {
+			auto const& r = results_[i];
+			std::printf("%s\n    {\"name\": \"%s\", \"median_ms\": %.6f, \"p99_ms\": %.6f, \"min_ms\": %.6f, "
+					"\"allocations\": %zu, \"throughput\": %.3f, \"unit\": \"%s\"}",
+					i ? "," : "", r.name.c_str(), r.median() * 1e3, r.p99() * 1e3, r.min() * 1e3,
+					r.allocations, r.items ? r.items / r.median() : 0.0, r.items ? (r.unit + "/s").c_str() : "");
+		}
+		std::printf("\n  ]\n}\n");
+	}
+
+private:
+	static void print(result const& r)
+	{
+		std::printf("%-24s median %10.3f ms  p99 %10.3f ms  %10zu allocs", r.name.c_str(),
+				r.median() * 1e3, r.p99() * 1e3, r.allocations);
+		if (r.items)
+			std::printf("  %10.2f M%s/s", r.items / r.median() / 1e6, r.unit.c_str());
+		std::printf("\n");
+	}
+
+	options opt_;
+	std::vector<result> results_;
+};
+
+}
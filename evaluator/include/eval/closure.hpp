@@ -0,0 +1,438 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ast/ast.hpp"
+#include "object/object.hpp"
+#include "object/env.hpp"
+#include "eval/literal.hpp"
+#include "eval/ops.hpp"
+#include "eval/resolve.hpp"
+
+namespace evaluator {
+inline namespace v_0_1 {
+
+// Closure compilation: every node of a resolved program is translated once
+// into an executor, a function pointer bound to what the node needs, its
+// operator, the address of its identifier, its literal value, and the
+// executors of its children. Running never looks at the AST again and
+// never dispatches on kinds. A function body is translated by its first
+// call. It is an EvalHandler of evaluator::eval<>, next to eval_handler.
+class closure_handler {
+public:
+	using Ret = obj::Value;
+	using Env = obj::environment;
+	using EnvPtr = std::shared_ptr<Env>;
+	using func = obj::function<ast::FunctionLiteral, obj::environment>;
+
+	static obj::Value eval(const ast::Program* program, EnvPtr env)
+	{
+		if (auto missing = resolve(program, *env, builtins)) return missing;
+		if (program->statements.empty()) return nullptr;
+		translator t;
+		auto root = t.block(program->statements);
+		context c{std::move(env), t};
+		return root.run(root, c);
+	}
+
+private:
+	using e = obj::eval_errc;
+	using err = obj::error;
+
+	class translator;
+
+	// the state of a run: the frame of the running function, and whether
+	// a return unwinds to it
+	struct context {
+		EnvPtr env;
+		translator& t;
+		bool returning = false;
+	};
+
+	struct node {
+		using fn = obj::Value (*)(const node&, context&);
+		fn run = nullptr;
+		ast::Op op = ast::Op::unknown;
+		std::uint16_t depth = 0;
+		std::uint32_t slot = 0;
+		// of a literal or of a builtin
+		obj::Value value{};
+		// the name of a read, for its error
+		const ast::Identifier* ident = nullptr;
+		const ast::FunctionLiteral* function = nullptr;
+		// inspect() of an array
+		std::string text{};
+		std::vector<node> kids{};
+	};
+
+	class translator {
+	public:
+		// a block, or the top level: its statements up to a return or an error
+		node block(ast::Statements const& stmts)
+		{
+			node n{&run_block};
+			for (auto const& s: stmts) n.kids.push_back(stmt(s.get()));
+			if (n.kids.empty()) n = constant(obj::M_NIL);
+			return n;
+		}
+
+		// the body of f, translated by the first call. Null for a syntax
+		// error in it.
+		const node* body(func* f)
+		{
+			auto* lit = f->fn_.get();
+			if (auto it = bodies_.find(lit); it != bodies_.end())
+				return &it->second.second;
+			auto* b = lit->block();
+			if (!b) return nullptr;
+			if (!lit->resolved_)
+				resolver{*f->env_, builtins}.resolve_body(lit);
+			// the literal is kept, so its address is not reused by another
+			auto [it, _] = bodies_.emplace(lit, std::pair{f->fn_, block(b->statements_)});
+			return &it->second.second;
+		}
+
+	private:
+		node stmt(const ast::Statement* s)
+		{
+			if (!s) return constant(obj::M_NIL);
+			switch (s->kind_) {
+				case ast::Kind::let: {
+					auto* l = static_cast<const ast::LetStmt*>(s);
+					auto const& a = l->name_->addr_;
+					node n{a.scope == ast::Address::local ? &run_let_local : &run_let_global};
+					n.slot = a.slot;
+					n.kids.push_back(expr(l->value_.get()));
+					return n;
+				}
+				case ast::Kind::ret: {
+					node n{&run_return};
+					n.kids.push_back(expr(static_cast<const ast::ReturnStmt*>(s)->return_value_.get()));
+					return n;
+				}
+				case ast::Kind::expr_stmt:
+					return expr(static_cast<const ast::ExpressionStmt*>(s)->expression_.get());
+				case ast::Kind::block:
+					return block(static_cast<const ast::BlockStmt*>(s)->statements_);
+				default:
+					return constant(obj::M_NIL);
+			}
+		}
+
+		node expr(const ast::Expression* e)
+		{
+			if (!e) return constant(obj::M_NIL);
+			switch (e->kind_) {
+				case ast::Kind::ident:
+					return ident(static_cast<const ast::Identifier*>(e));
+				case ast::Kind::integer:
+					return constant(literal(static_cast<const ast::IntegerLiteral*>(e)));
+				case ast::Kind::boolean:
+					return constant(obj::Value::boolean(static_cast<const ast::Boolean*>(e)->value_));
+				case ast::Kind::string:
+					return constant(literal(static_cast<const ast::StringLiteral*>(e)));
+				case ast::Kind::prefix: {
+					auto* p = static_cast<const ast::PrefixExpression*>(e);
+					node n{&run_prefix, p->op_};
+					n.kids.push_back(expr(p->right_.get()));
+					return n;
+				}
+				case ast::Kind::infix: {
+					auto* i = static_cast<const ast::InfixExpression*>(e);
+					node n{infix_of(i->op_), i->op_};
+					n.kids.push_back(expr(i->left_.get()));
+					n.kids.push_back(expr(i->right_.get()));
+					return n;
+				}
+				case ast::Kind::if_expr: {
+					auto* i = static_cast<const ast::IfExpression*>(e);
+					node n{&run_if};
+					n.kids.push_back(expr(i->cond_.get()));
+					n.kids.push_back(i->consequence_ ? block(i->consequence_->statements_) : constant(obj::M_NIL));
+					n.kids.push_back(i->alternative_ ? block(i->alternative_->statements_) : constant(obj::M_NIL));
+					return n;
+				}
+				case ast::Kind::function: {
+					node n{&run_closure};
+					n.function = static_cast<const ast::FunctionLiteral*>(e);
+					return n;
+				}
+				case ast::Kind::call: {
+					auto* c = static_cast<const ast::CallExpression*>(e);
+					node n{&run_call};
+					n.kids.push_back(expr(c->fn_.get()));
+					for (auto const& arg: c->args_) n.kids.push_back(expr(arg.get()));
+					return n;
+				}
+				case ast::Kind::array: {
+					auto* a = static_cast<const ast::ArrayLiteral*>(e);
+					if (auto elems = literal(a)) {
+						node n{&run_constant_array};
+						n.value = std::move(elems);
+						return n;
+					}
+					node n{&run_array};
+					for (auto const& elem: a->elements_) n.kids.push_back(expr(elem.get()));
+					n.text = a->to_string();
+					return n;
+				}
+				case ast::Kind::index: {
+					auto* i = static_cast<const ast::IndexExpression*>(e);
+					node n{&run_index};
+					n.kids.push_back(expr(i->left_.get()));
+					n.kids.push_back(expr(i->index_.get()));
+					return n;
+				}
+				case ast::Kind::hash: {
+					auto* h = static_cast<const ast::HashTableLiteral*>(e);
+					if (auto kept = literal(h)) return constant(std::move(kept));
+					node n{&run_hash};
+					for (auto const& [k, v]: h->pairs_) {
+						n.kids.push_back(expr(k.get()));
+						n.kids.push_back(expr(v.get()));
+					}
+					return n;
+				}
+				default:
+					return constant(obj::M_NIL);
+			}
+		}
+
+		node ident(const ast::Identifier* i)
+		{
+			auto const& a = i->addr_;
+			node n;
+			n.ident = i;
+			n.depth = a.depth;
+			n.slot = a.slot;
+			switch (a.scope) {
+				case ast::Address::local: n.run = a.depth ? &run_local : &run_local0; break;
+				case ast::Address::global: n.run = &run_global; break;
+				case ast::Address::builtin: return constant(obj::Value{&builtins[a.slot].second});
+				default: n.run = &run_undefined; break;
+			}
+			return n;
+		}
+
+		static node constant(obj::Value v)
+		{
+			node n{&run_constant};
+			n.value = std::move(v);
+			return n;
+		}
+
+		// integer operands skip the operator table
+		template<ast::Op Op>
+		static obj::Value run_int_infix(const node& n, context& c)
+		{
+			auto left = n.kids[0].run(n.kids[0], c);
+			if (left.type() == obj::ERROR) return left;
+			auto right = n.kids[1].run(n.kids[1], c);
+			if (right.type() == obj::ERROR) return right;
+			if (left.type() != obj::INTEGER || right.type() != obj::INTEGER)
+				return ops::infix(Op, std::move(left), std::move(right));
+			auto l = left.as_int(), r = right.as_int();
+			switch (Op) {
+				case ast::Op::plus: return ops::integer_into(left.unique() ? left : right, l + r);
+				case ast::Op::minus: return ops::integer_into(left.unique() ? left : right, l - r);
+				case ast::Op::asterisk: return ops::integer_into(left.unique() ? left : right, l * r);
+				case ast::Op::lt: return obj::Value::boolean(l < r);
+				case ast::Op::gt: return obj::Value::boolean(l > r);
+				case ast::Op::eq: return obj::Value::boolean(l == r);
+				case ast::Op::neq: return obj::Value::boolean(l != r);
+				default: return ops::infix(Op, std::move(left), std::move(right));
+			}
+		}
+
+		static node::fn infix_of(ast::Op op)
+		{
+			switch (op) {
+				case ast::Op::plus: return &run_int_infix<ast::Op::plus>;
+				case ast::Op::minus: return &run_int_infix<ast::Op::minus>;
+				case ast::Op::asterisk: return &run_int_infix<ast::Op::asterisk>;
+				case ast::Op::lt: return &run_int_infix<ast::Op::lt>;
+				case ast::Op::gt: return &run_int_infix<ast::Op::gt>;
+				case ast::Op::eq: return &run_int_infix<ast::Op::eq>;
+				case ast::Op::neq: return &run_int_infix<ast::Op::neq>;
+				default: return &run_infix;
+			}
+		}
+
+		std::unordered_map<const ast::FunctionLiteral*, std::pair<std::shared_ptr<const ast::FunctionLiteral>, node>> bodies_;
+	};
+
+	static obj::Value run_constant(const node& n, context&)
+	{
+		return n.value;
+	}
+
+	static obj::Value run_block(const node& n, context& c)
+	{
+		obj::Value res;
+		for (auto const& k: n.kids) {
+			res = k.run(k, c);
+			if (c.returning || res.type() == obj::ERROR) break;
+		}
+		return res;
+	}
+
+	static obj::Value run_let_local(const node& n, context& c)
+	{
+		auto v = n.kids[0].run(n.kids[0], c);
+		if (v.type() != obj::ERROR) c.env->bind(n.slot, v);
+		return v;
+	}
+
+	static obj::Value run_let_global(const node& n, context& c)
+	{
+		auto v = n.kids[0].run(n.kids[0], c);
+		if (v.type() != obj::ERROR) c.env->set(n.slot, v);
+		return v;
+	}
+
+	static obj::Value run_return(const node& n, context& c)
+	{
+		auto v = n.kids[0].run(n.kids[0], c);
+		if (v.type() != obj::ERROR) c.returning = true;
+		return v;
+	}
+
+	static obj::Value read(const obj::Value* v, const node& n, context& c)
+	{
+		if (v) return *v;
+		if (auto around = unset(*c.env, n.ident->addr_, builtins)) return around;
+		// read before its let
+		return err::make(e::identifier_not_defined, std::string(n.ident->name()));
+	}
+
+	static obj::Value run_local0(const node& n, context& c)
+	{
+		return read(c.env->slot(n.slot), n, c);
+	}
+
+	static obj::Value run_local(const node& n, context& c)
+	{
+		return read(c.env->frame(n.depth).slot(n.slot), n, c);
+	}
+
+	static obj::Value run_global(const node& n, context& c)
+	{
+		return read(c.env->globals().slot(n.slot), n, c);
+	}
+
+	static obj::Value run_undefined(const node& n, context& c)
+	{
+		return read(nullptr, n, c);
+	}
+
+	static obj::Value run_prefix(const node& n, context& c)
+	{
+		auto right = n.kids[0].run(n.kids[0], c);
+		if (right.type() == obj::ERROR) return right;
+		return ops::prefix(n.op, std::move(right));
+	}
+
+	static obj::Value run_infix(const node& n, context& c)
+	{
+		auto left = n.kids[0].run(n.kids[0], c);
+		if (left.type() == obj::ERROR) return left;
+		auto right = n.kids[1].run(n.kids[1], c);
+		if (right.type() == obj::ERROR) return right;
+		return ops::infix(n.op, std::move(left), std::move(right));
+	}
+
+	static obj::Value run_if(const node& n, context& c)
+	{
+		auto cond = n.kids[0].run(n.kids[0], c);
+		if (cond.type() == obj::ERROR) return cond;
+		auto const& branch = n.kids[ops::truthy(cond) ? 1 : 2];
+		return branch.run(branch, c);
+	}
+
+	static obj::Value run_closure(const node& n, context& c)
+	{
+		return obj::Value{new func{*n.function, c.env}};
+	}
+
+	static obj::Value run_call(const node& n, context& c)
+	{
+		auto fn = n.kids[0].run(n.kids[0], c);
+		if (fn.type() == obj::ERROR) return fn;
+		std::vector<obj::Value> args;
+		args.reserve(n.kids.size() - 1);
+		for (std::size_t i = 1; i < n.kids.size(); ++i) {
+			auto a = n.kids[i].run(n.kids[i], c);
+			if (a.type() == obj::ERROR) return a;
+			args.push_back(std::move(a));
+		}
+
+		if (fn.type() == obj::BUILTIN)
+			return static_cast<obj::builtin*>(fn.get())->fn_(std::move(args));
+		if (fn.type() != obj::FUNCTION)
+			return err::make(e::not_a_function, fn.inspect());
+
+		auto* f = static_cast<func*>(fn.get());
+		auto* body = c.t.body(f);
+		if (!body) return err::make(e::syntax_error, std::string(f->fn_->error()));
+		auto frame = std::make_shared<Env>(f->env_, f->fn_->frame_size_);
+		auto const& params = f->fn_->parameters_;
+		for (std::size_t i = 0; i < args.size() && i < params.size(); ++i)
+			frame->bind(params[i]->addr_.slot, std::move(args[i]));
+
+		auto caller = std::exchange(c.env, std::move(frame));
+		auto res = body->run(*body, c);
+		auto done = std::exchange(c.env, std::move(caller));
+		done->collect<func>(done.use_count());
+		c.returning = false;
+		return res;
+	}
+
+	static obj::Value run_array(const node& n, context& c)
+	{
+		obj::array::Elements elems;
+		elems.reserve(n.kids.size());
+		for (auto const& k: n.kids) {
+			auto v = k.run(k, c);
+			if (v.type() == obj::ERROR) return v;
+			elems.push_back(std::move(v));
+		}
+		return obj::Value{new obj::array(std::move(elems), n.text)};
+	}
+
+	// a new array of the elements of the one in value
+	static obj::Value run_constant_array(const node& n, context&)
+	{
+		auto const& proto = *static_cast<const obj::array*>(n.value.get());
+		return obj::Value{new obj::array(obj::array::Elements(*proto.elements_), proto.ins_cache_)};
+	}
+
+	static obj::Value run_index(const node& n, context& c)
+	{
+		auto set = n.kids[0].run(n.kids[0], c);
+		if (set.type() == obj::ERROR) return set;
+		auto index = n.kids[1].run(n.kids[1], c);
+		if (index.type() == obj::ERROR) return index;
+		return ops::index(set, index);
+	}
+
+	static obj::Value run_hash(const node& n, context& c)
+	{
+		obj::hashtable::HashTable ht;
+		for (std::size_t i = 0; i < n.kids.size(); i += 2) {
+			auto k = n.kids[i].run(n.kids[i], c);
+			if (k.type() == obj::ERROR) return k;
+			auto v = n.kids[i + 1].run(n.kids[i + 1], c);
+			if (v.type() == obj::ERROR) return v;
+			ht.emplace(std::move(k), std::move(v));
+		}
+		return obj::Value{new obj::hashtable{std::move(ht)}};
+	}
+
+	static inline obj::builtin::Builtins builtins = obj::builtin::create_builtins();
+};
+
+} // v_0_1
+}
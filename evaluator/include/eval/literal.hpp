@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+
+#include "ast/ast.hpp"
+#include "object/object.hpp"
+
+namespace evaluator {
+inline namespace v_0_1 {
+
+// The values of the literals, built by their first evaluation and kept on
+// their node: evaluating a literal again shares the same value. A kept
+// value is never changed in place, as its node holds a handle to it.
+//
+// A literal is constant when its elements, or its keys and values, are
+// integer, boolean or string literals. A constant hashtable is shared
+// whole. An array is changed by append, so a constant array keeps only
+// its elements, each evaluation is a new array of them.
+namespace detail {
+
+inline void release(std::uintptr_t w) { obj::Value::adopt(w); }
+// kept by a literal which is not constant
+inline void none(std::uintptr_t) {}
+
+template<class F>
+obj::Value kept(ast::Constant const& c, F&& build)
+{
+	if (!c.release) {
+		auto v = build();
+		c.release = v ? &release : &none;
+		c.word = std::move(v).take();
+	}
+	return obj::Value::share(c.word);
+}
+
+}
+
+inline obj::Value literal(const ast::IntegerLiteral* i)
+{
+	return detail::kept(i->constant_, [i] { return obj::Value::integer(i->value_); });
+}
+
+inline obj::Value literal(const ast::StringLiteral* s)
+{
+	return detail::kept(s->constant_, [s] { return obj::Value{new obj::string{s->value_}}; });
+}
+
+// of an integer, boolean or string literal, null for another node
+inline obj::Value scalar(const ast::Expression* e)
+{
+	if (!e) return nullptr;
+	switch (e->kind_) {
+		case ast::Kind::integer: return literal(static_cast<const ast::IntegerLiteral*>(e));
+		case ast::Kind::boolean: return obj::Value::boolean(static_cast<const ast::Boolean*>(e)->value_);
+		case ast::Kind::string: return literal(static_cast<const ast::StringLiteral*>(e));
+		default: return nullptr;
+	}
+}
+
+// a new array of the kept elements, null if a is not constant
+inline obj::Value literal(const ast::ArrayLiteral* a)
+{
+	auto kept = detail::kept(a->constant_, [a] {
+		obj::array::Elements elems;
+		elems.reserve(a->elements_.size());
+		for (auto const& e: a->elements_) {
+			auto v = scalar(e.get());
+			if (!v) return obj::Value{};
+			elems.push_back(std::move(v));
+		}
+		return obj::Value{new obj::array(std::move(elems), a->to_string())};
+	});
+	if (!kept) return nullptr;
+	auto const& proto = *static_cast<const obj::array*>(kept.get());
+	return obj::Value{new obj::array(obj::array::Elements(*proto.elements_), proto.ins_cache_)};
+}
+
+// the kept hashtable, null if h is not constant
+inline obj::Value literal(const ast::HashTableLiteral* h)
+{
+	return detail::kept(h->constant_, [h] {
+		obj::hashtable::HashTable ht;
+		for (auto const& [ke, ve]: h->pairs_) {
+			auto k = scalar(ke.get()), v = scalar(ve.get());
+			if (!k || !v) return obj::Value{};
+			ht.emplace(std::move(k), std::move(v));
+		}
+		return obj::Value{new obj::hashtable{std::move(ht)}};
+	});
+}
+
+} // v_0_1
+}
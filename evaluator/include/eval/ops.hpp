@@ -0,0 +1,185 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <initializer_list>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "ast/ast.hpp"
+#include "object/object.hpp"
+
+// The operations on values, the same for every engine: operators, index
+// and truthiness. An error is returned as an error object.
+namespace evaluator {
+inline namespace v_0_1 {
+namespace ops {
+
+using e = obj::eval_errc;
+using err = obj::error;
+
+inline std::string join(std::initializer_list<std::string_view> list, char cat = ' ')
+{
+	std::ostringstream out;
+	std::for_each(list.begin(), list.end() - 1, [&out, cat](std::string_view s) {
+			out << s << cat;
+			});
+	out << *(list.end() - 1);
+	return out.str();
+}
+
+// used for cond in if
+inline bool truthy(obj::Value const& cond)
+{
+	return !(cond == obj::Value::nil() || cond == obj::Value::boolean(false));
+}
+
+// the entries of the operator tables. The operands are owned by the
+// operation: one no one else has is reused for the result.
+using prefix_fn = obj::Value (*)(ast::Op, obj::Value&);
+using infix_fn = obj::Value (*)(ast::Op, obj::Value&, obj::Value&);
+
+// v, written into owned if it is an integer object no one else has
+inline obj::Value integer_into(obj::Value& owned, std::int64_t v)
+{
+	if (!obj::Value::immediate(v) && owned.unique()) {
+		static_cast<obj::integer*>(owned.get())->value_ = v;
+		return std::move(owned);
+	}
+	return obj::Value::integer(v);
+}
+
+inline obj::Value bang(ast::Op, obj::Value& right)
+{
+	return obj::Value::boolean(!truthy(right));
+}
+
+inline obj::Value negate(ast::Op, obj::Value& right)
+{
+	return integer_into(right, -right.as_int());
+}
+
+inline obj::Value unknown_prefix(ast::Op op, obj::Value& right)
+{
+	return err::make(e::unknown_operator, join({ast::spelling(op), right.inspect()}));
+}
+
+template<class F>
+obj::Value int_infix(ast::Op, obj::Value& l, obj::Value& r)
+{
+	auto v = F{}(l.as_int(), r.as_int());
+	if constexpr (std::is_same_v<decltype(v), bool>)
+		return obj::Value::boolean(v);
+	else
+		return integer_into(l.unique() ? l : r, v);
+}
+
+// appends to the left string, or prepends to the right one, when it is a
+// temporary, so that `s + "x"` does not copy s into a new string
+inline obj::Value concat(ast::Op, obj::Value& l, obj::Value& r)
+{
+	auto& ls = static_cast<obj::string*>(l.get())->value_;
+	auto& rs = static_cast<obj::string*>(r.get())->value_;
+	if (l.unique()) {
+		ls += rs;
+		return std::move(l);
+	}
+	if (r.unique()) {
+		rs.insert(0, ls);
+		return std::move(r);
+	}
+	return obj::Value{new obj::string{ls + rs}};
+}
+
+inline obj::Value string_eq(ast::Op, obj::Value& l, obj::Value& r)
+{
+	return obj::Value::boolean(static_cast<obj::string*>(l.get())->value_ == static_cast<obj::string*>(r.get())->value_);
+}
+
+// booleans and nil are immediate, the others are never the same
+template<bool Eq>
+obj::Value same(ast::Op, obj::Value& l, obj::Value& r)
+{
+	return obj::Value::boolean((l == r) == Eq);
+}
+
+inline obj::Value unknown_infix(ast::Op op, obj::Value& l, obj::Value& r)
+{
+	return err::make(e::unknown_operator, join({l.inspect(), ast::spelling(op), r.inspect()}));
+}
+
+// right is reused when the caller moves a temporary in
+inline obj::Value prefix(ast::Op op, obj::Value right)
+{
+	// [type of the operand][operator]
+	static constexpr auto table = [] {
+		std::array<std::array<prefix_fn, ast::ops>, obj::types> t{};
+		for (auto& row: t) {
+			row.fill(&unknown_prefix);
+			row[ast::index(ast::Op::bang)] = &bang;
+		}
+		t[obj::INTEGER][ast::index(ast::Op::minus)] = &negate;
+		return t;
+	}();
+	return table[right.type()][ast::index(op)](op, right);
+}
+
+// as prefix(), for the operands. Inlined, so the operands are not copied
+// through a call into the table
+__attribute__((always_inline)) inline obj::Value infix(ast::Op op, obj::Value left, obj::Value right)
+{
+	if (left.type() != right.type())
+		return err::make(e::type_mismatch, join({left.inspect(), ast::spelling(op), right.inspect()}));
+
+	// [type of both operands][operator], the other types only compare
+	// by identity
+	static constexpr auto table = [] {
+		std::array<std::array<infix_fn, ast::ops>, obj::types> t{};
+		for (auto& row: t) {
+			row.fill(&unknown_infix);
+			row[ast::index(ast::Op::eq)] = &same<true>;
+			row[ast::index(ast::Op::neq)] = &same<false>;
+		}
+		auto& i = t[obj::INTEGER];
+		i[ast::index(ast::Op::plus)] = &int_infix<std::plus<>>;
+		i[ast::index(ast::Op::minus)] = &int_infix<std::minus<>>;
+		i[ast::index(ast::Op::asterisk)] = &int_infix<std::multiplies<>>;
+		i[ast::index(ast::Op::slash)] = &int_infix<std::divides<>>;
+		i[ast::index(ast::Op::lt)] = &int_infix<std::less<>>;
+		i[ast::index(ast::Op::gt)] = &int_infix<std::greater<>>;
+		i[ast::index(ast::Op::eq)] = &int_infix<std::equal_to<>>;
+		i[ast::index(ast::Op::neq)] = &int_infix<std::not_equal_to<>>;
+		auto& s = t[obj::STRING];
+		s.fill(&unknown_infix);
+		s[ast::index(ast::Op::plus)] = &concat;
+		s[ast::index(ast::Op::eq)] = &string_eq;
+		return t;
+	}();
+	return table[left.type()][ast::index(op)](op, left, right);
+}
+
+// index of array shoule return elem ref
+// but now all var is readonly, so return the shared elem
+inline obj::Value index(obj::Value const& set, obj::Value const& key)
+{
+	if (set.type() == obj::ARRAY && key.type() == obj::INTEGER) {
+		obj::array::Elements const& elems = *static_cast<const obj::array*>(set.get())->elements_;
+		std::int64_t idx = key.as_int();
+		return idx >= 0 && static_cast<std::size_t>(idx) < elems.size() ? elems[idx] : err::make(e::array, "out of range");
+	}
+	if (set.type() == obj::HASHTABLE) {
+		obj::hashtable::HashTable const& h = *static_cast<const obj::hashtable*>(set.get())->ht_;
+		if (!obj::hashtable::hashable(key.type()))
+			return err::make(e::hashtable, "key is not hashable " + key.inspect());
+		if (auto it = h.find(key); it != h.end())
+			return it->second;
+		return obj::Value::nil();
+	}
+	return err::make(e::type_mismatch, "cannot index");
+}
+
+} // ops
+} // v_0_1
+}
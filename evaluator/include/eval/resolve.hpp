@@ -0,0 +1,288 @@
+#pragma once
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "ast/ast.hpp"
+#include "object/object.hpp"
+#include "object/env.hpp"
+
+namespace evaluator {
+inline namespace v_0_1 {
+
+// Lexical addressing: sets the Address of the identifiers of a program and
+// the frame size of its function literals, before it is evaluated.
+//
+// The slots of a function are its parameters, then the lets of its body
+// out of the functions nested in it, wherever they are in the body. A name
+// is a slot of the nearest function having it, else a global if the
+// program lets it at top level or the environment has it, else a builtin.
+// In the body of the function itself, a let is seen from its statement on,
+// before it the name is the one of the scopes around; the bodies nested in
+// it run later and see all of its lets. A let in a branch, or one a nested
+// body reads, may not have run by the read: while its slot is unset, the
+// name is the one of the scopes around, as Address::unset says.
+//
+// Any other name read in a function is a global bound late, looked up by
+// its call: the program, or a later one sharing the environment, may let
+// it by then. Read at top level, it is missing and stays unresolved.
+//
+// A lazy body is not parsed here: its literal keeps a copy of the scopes
+// around it, and resolve_body() resolves it at its first call.
+class resolver {
+public:
+	resolver(obj::environment& env, obj::builtin::Builtins const& builtins):
+		env_(env.globals()), builtins_(builtins) {}
+
+	// the names missing in the program
+	std::vector<std::string> resolve(const ast::Program* program)
+	{
+		declaring_ = true;
+		for (auto const& s: program->statements) visit(s.get());
+		declaring_ = false;
+		for (auto const& s: program->statements) visit(s.get());
+		return std::move(missing_);
+	}
+
+	// a lazy body, once parsed
+	void resolve_body(const ast::FunctionLiteral* f)
+	{
+		// the scopes around it are in the arena already
+		for (auto* s = f->scope_; s; s = s->upper) kept_.emplace(s, s);
+		function(f, f->scope_);
+	}
+
+private:
+	void visit(const ast::Statement* s)
+	{
+		if (!s) return;
+		switch (s->kind_) {
+			case ast::Kind::let: {
+				auto* l = static_cast<const ast::LetStmt*>(s);
+				if (declaring_) declare(l->name_->symbol_);
+				// the value does not see the name it is let to
+				visit(l->value_.get());
+				if (!declaring_) bind(l->name_.get());
+				break;
+			}
+			case ast::Kind::ret:
+				visit(static_cast<const ast::ReturnStmt*>(s)->return_value_.get());
+				break;
+			case ast::Kind::expr_stmt:
+				visit(static_cast<const ast::ExpressionStmt*>(s)->expression_.get());
+				break;
+			case ast::Kind::block:
+				++blocks_;
+				for (auto const& stmt: static_cast<const ast::BlockStmt*>(s)->statements_)
+					visit(stmt.get());
+				--blocks_;
+				break;
+			default:
+				break;
+		}
+	}
+
+	void visit(const ast::Expression* e)
+	{
+		if (!e) return;
+		switch (e->kind_) {
+			case ast::Kind::ident:
+				if (!declaring_) lookup(static_cast<const ast::Identifier*>(e));
+				break;
+			case ast::Kind::prefix:
+				visit(static_cast<const ast::PrefixExpression*>(e)->right_.get());
+				break;
+			case ast::Kind::infix: {
+				auto* i = static_cast<const ast::InfixExpression*>(e);
+				visit(i->left_.get());
+				visit(i->right_.get());
+				break;
+			}
+			case ast::Kind::if_expr: {
+				auto* i = static_cast<const ast::IfExpression*>(e);
+				visit(i->cond_.get());
+				visit(i->consequence_.get());
+				visit(i->alternative_.get());
+				break;
+			}
+			case ast::Kind::function:
+				// its lets are its own
+				if (!declaring_) function(static_cast<const ast::FunctionLiteral*>(e), scope_);
+				break;
+			case ast::Kind::call: {
+				auto* c = static_cast<const ast::CallExpression*>(e);
+				visit(c->fn_.get());
+				for (auto const& arg: c->args_) visit(arg.get());
+				break;
+			}
+			case ast::Kind::array:
+				for (auto const& elem: static_cast<const ast::ArrayLiteral*>(e)->elements_)
+					visit(elem.get());
+				break;
+			case ast::Kind::index: {
+				auto* i = static_cast<const ast::IndexExpression*>(e);
+				visit(i->left_.get());
+				visit(i->index_.get());
+				break;
+			}
+			case ast::Kind::hash:
+				for (auto const& [k, v]: static_cast<const ast::HashTableLiteral*>(e)->pairs_) {
+					visit(k.get());
+					visit(v.get());
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	void function(const ast::FunctionLiteral* f, const ast::Scope* upper)
+	{
+		if (!f->parsed()) {
+			f->scope_ = keep(upper, *f->arena_);
+			f->resolved_ = false;
+			return;
+		}
+		auto* body = f->block();
+		ast::Scope scope{{}, upper};
+		auto* outer = std::exchange(scope_, &scope);
+		auto outer_bound = std::exchange(bound_, {});
+		auto outer_sure = std::exchange(sure_, {});
+		auto* outer_arena = std::exchange(arena_, f->arena_);
+		auto outer_blocks = std::exchange(blocks_, 0);
+		for (auto const& p: f->parameters_) {
+			declare(p->symbol_);
+			bind(p.get());
+		}
+		declaring_ = true;
+		visit(body);
+		declaring_ = false;
+		visit(body);
+		scope_ = outer;
+		bound_ = std::move(outer_bound);
+		sure_ = std::move(outer_sure);
+		arena_ = outer_arena;
+		blocks_ = outer_blocks;
+		// the address may be reused by the next scope
+		kept_.erase(&scope);
+		f->frame_size_ = scope.names.size();
+		f->resolved_ = true;
+	}
+
+	void declare(symbol::id name)
+	{
+		if (!scope_) {
+			globals_.insert(name);
+			return;
+		}
+		auto& names = scope_->names;
+		if (std::find(names.begin(), names.end(), name) == names.end())
+			names.push_back(name);
+	}
+
+	// the identifier a let or a parameter binds, declared
+	void bind(const ast::Identifier* i)
+	{
+		if (!scope_) {
+			i->addr_ = {ast::Address::global, 0, i->symbol_};
+			return;
+		}
+		auto const& names = scope_->names;
+		auto slot = std::find(names.begin(), names.end(), i->symbol_) - names.begin();
+		i->addr_ = {ast::Address::local, 0, static_cast<std::uint32_t>(slot)};
+		bound_.push_back(i->symbol_);
+		// a parameter, or a let of the body out of its branches
+		if (blocks_ <= 1) sure_.push_back(i->symbol_);
+	}
+
+	void lookup(const ast::Identifier* i)
+	{
+		i->addr_ = address(i->symbol_, scope_, 0);
+		if (i->addr_.scope == ast::Address::unresolved)
+			missing_.emplace_back(i->name());
+	}
+
+	// of name, in s and the scopes around it, s being depth functions up
+	ast::Address address(symbol::id name, const ast::Scope* s, std::uint16_t depth)
+	{
+		for (; s; s = s->upper, ++depth) {
+			if (!depth && std::find(bound_.begin(), bound_.end(), name) == bound_.end())
+				continue;
+			auto it = std::find(s->names.begin(), s->names.end(), name);
+			if (it == s->names.end()) continue;
+			ast::Address a{ast::Address::local, depth, static_cast<std::uint32_t>(it - s->names.begin())};
+			if (depth || std::find(sure_.begin(), sure_.end(), name) == sure_.end())
+				a.unset = arena_->make<ast::Address>(address(name, s->upper, depth + 1));
+			return a;
+		}
+		if (globals_.contains(name) || env_.defined(name))
+			return {ast::Address::global, 0, name};
+		for (std::uint32_t b = 0; b < builtins_.size(); ++b)
+			if (builtins_[b].first == name) return {ast::Address::builtin, 0, b};
+		if (scope_) return {ast::Address::global, 0, name};
+		return {};
+	}
+
+	// a copy of the scopes in the arena, for a lazy body. The functions
+	// of a scope are in one arena, so the copy serves all its lazy bodies.
+	const ast::Scope* keep(const ast::Scope* s, ast::Arena& arena)
+	{
+		if (!s) return nullptr;
+		if (auto it = kept_.find(s); it != kept_.end()) return it->second;
+		auto* k = arena.make<ast::Scope>(
+				std::pmr::vector<symbol::id>(s->names.begin(), s->names.end(), arena.resource()),
+				keep(s->upper, arena));
+		kept_.emplace(s, k);
+		return k;
+	}
+
+	obj::environment& env_;
+	obj::builtin::Builtins const& builtins_;
+	// the innermost function, null at top level
+	ast::Scope* scope_ = nullptr;
+	bool declaring_ = false;
+	// the names of scope_ let so far, and those of them sure to be set
+	std::vector<symbol::id> bound_;
+	std::vector<symbol::id> sure_;
+	// the blocks around the statement, the body being the first
+	int blocks_ = 0;
+	// of the function of scope_, for the unset addresses
+	ast::Arena* arena_ = nullptr;
+	// the lets of the top level
+	std::unordered_set<symbol::id> globals_;
+	std::unordered_map<const ast::Scope*, const ast::Scope*> kept_;
+	std::vector<std::string> missing_;
+};
+
+// a local read while its slot is unset: the value of the name in the
+// scopes around, see Address::unset, null if none has it
+inline obj::Value unset(obj::environment& env, ast::Address const& a, obj::builtin::Builtins& builtins)
+{
+	for (auto* at = a.unset; at; at = at->unset) {
+		const obj::Value* v = nullptr;
+		switch (at->scope) {
+			case ast::Address::local: v = env.frame(at->depth).slot(at->slot); break;
+			case ast::Address::global: v = env.globals().slot(at->slot); break;
+			case ast::Address::builtin: return obj::Value{&builtins[at->slot].second};
+			default: break;
+		}
+		if (v) return *v;
+	}
+	return nullptr;
+}
+
+// resolves program, an error naming what is missing or null
+inline obj::Value resolve(const ast::Program* program, obj::environment& env, obj::builtin::Builtins const& builtins)
+{
+	auto missing = resolver{env, builtins}.resolve(program);
+	if (missing.empty()) return nullptr;
+	std::string names;
+	for (auto const& m: missing) names += (names.empty() ? "" : ", ") + m;
+	return obj::error::make(obj::eval_errc::identifier_not_defined, names);
+}
+
+} // v_0_1
+}
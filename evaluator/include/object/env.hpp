@@ -1,61 +1,116 @@
 #pragma once
-#include <unordered_map>
+#include <vector>
 
 #include "object.hpp"
-#include "ast/ast.hpp"
+#include "lexer/symbol.hpp"
 
 namespace obj {
 
-template<class Base, class Derived = void>
-struct _clone {
-	static Derived* on_success(const Derived* p) { return new Derived(*p); }
-	static Base* on_fail(const Base* p) { return const_cast<Base*>(p); }
-};
+// A frame of slots. The root frame holds the globals, whose slot is their
+// symbol, the frame of a call holds the parameters and the lets of the
+// function, at the slots given by the resolver.
+//
+// A function value holds the frame it is made in, and so the root: a
+// function in a global is a cycle, which keeps the root, the functions and
+// the arenas of their literals alive. The owner of a root frame clear()s it
+// when done with it. A function let in a call is a cycle through the frame
+// of the call: the engines collect() the frame as the call ends, which
+// frees it when only such functions hold it. A cycle through anything else,
+// such as a function in an array let in the call, is not found: it keeps
+// its frame, and the arena of the program, alive.
+class environment {
+public:
+	environment(): globals_(this) {}
+	environment(std::shared_ptr<environment> upper, std::size_t size):
+		slots_(size), upper_(std::move(upper)), globals_(upper_->globals_) {}
+	environment(environment const&) = delete;
+	environment& operator=(environment const&) = delete;
+
+	// a global by name
+	std::pair<Value, bool> get(symbol::id key)
+	{
+		if (auto* v = globals_->slot(key))
+			return std::pair{*v, true};
+		return {nullptr, false};
+	}
 
+	void set(symbol::id key, Value val)
+	{
+		if (globals_->slots_.size() <= key)
+			globals_->slots_.resize(key + 1);
+		globals_->bind(key, std::move(val));
+	}
 
-template<template<typename B, typename D = void> class Clone, class Base>
-	Base* clone(const Base* ptr)
+	bool defined(symbol::id key) const noexcept
 	{
-		return Clone<Base>::on_fail(ptr);
+		return globals_->slot(key);
 	}
 
-template<template<typename B, typename D = void> class Clone,
-	class Base, class Derived, class ...More>
-	Base* clone(const Base* ptr)
+	// the frame of the function depth functions up, 0 for this one
+	environment& frame(std::size_t depth) noexcept
 	{
-		auto* p = dynamic_cast<const Derived*>(ptr);
-		return p ? Clone<Base, Derived>::on_success(p) :
-			clone<Clone, Base, More...>(ptr);
+		auto* e = this;
+		while (depth--) e = e->upper_.get();
+		return *e;
 	}
 
-class environment {
-public:
-	environment() = default;
-	environment(std::shared_ptr<environment> upper): store_(), upper_(upper) {}
+	environment& globals() noexcept { return *globals_; }
 
-	std::pair<object_ptr, bool> get(std::string const& key)
+	// drops the globals, breaking the cycles through them
+	void clear() noexcept
 	{
-		if (store_.contains(key))
-			return std::pair{object_ptr{clone_obj(store_[key].get())}, true};
-		if (upper_)
-			return upper_->get(key);
-		return {nullptr, false};
+		// released once out of the frame, so no release sees it half cleared
+		auto slots = std::move(globals_->slots_);
+		globals_->slots_.clear();
 	}
 
-	void set(std::string key, const object* val)
+	// at the end of a call, with uses the count of the handles of this frame:
+	// when they are the caller's and those of the functions made here and
+	// held by its slots alone, nothing reaches the frame and its slots are
+	// dropped. Function is the type of the function values.
+	template<class Function>
+	void collect(long uses) noexcept
 	{
-		// deep clone?
-		store_.emplace(key, clone_obj(val));
+		long own = 0;
+		for (auto const& v: slots_)
+			if (v.unique() && v.type() == FUNCTION && static_cast<Function*>(v.get())->env_.get() == this)
+				++own;
+		if (!own || uses != own + 1) return;
+		auto slots = std::move(slots_);
+		slots_.clear();
 	}
 
-	static inline auto clone_obj = clone<_clone, obj::object,
-							obj::integer,
-							obj::function<ast::FunctionLiteral, environment>,
-							obj::string,
-							obj::array,
-							obj::hashtable>;
+	// drops the slots and the upper frame of a spent frame, keeping the
+	// storage for a next call
+	void release() noexcept
+	{
+		slots_.clear();
+		upper_.reset();
+	}
+
+	// a released frame made the frame of a call
+	void reuse(std::shared_ptr<environment> upper, std::size_t size)
+	{
+		slots_.resize(size);
+		upper_ = std::move(upper);
+		globals_ = upper_->globals_;
+	}
+
+	// null if unset
+	const Value* slot(std::size_t i) const noexcept
+	{
+		return i < slots_.size() && slots_[i] ? &slots_[i] : nullptr;
+	}
+
+	// a slot is set once, as a let does not rebind. The value is shared.
+	void bind(std::size_t i, Value val)
+	{
+		if (!slots_[i]) slots_[i] = std::move(val);
+	}
 private:
-	std::unordered_map<std::string, object_ptr> store_;
+	std::vector<Value> slots_;
 	std::shared_ptr<environment> upper_;
+	// the root frame, kept alive by upper_
+	environment* globals_;
 };
 }
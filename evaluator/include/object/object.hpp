@@ -3,12 +3,14 @@
 #include <string>
 #include <memory>
 #include <system_error>
+#include <utility>
 #include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <iostream>
 #include <sstream>
 // #include <functional>
+#include "lexer/symbol.hpp"
 
 namespace obj {
 
@@ -24,6 +26,8 @@ constexpr Type STRING = 7;
 constexpr Type BUILTIN = 8;
 constexpr Type ARRAY = 9;
 constexpr Type HASHTABLE = 10;
+// bound of the tags, for tables indexed by Type
+constexpr std::size_t types = HASHTABLE + 1;
 
 static std::string looktype(Type x)
 {
@@ -49,39 +53,45 @@ static std::string looktype(Type x)
 // };
 
 struct object {
-	virtual Type type() const = 0;
+	// set by the concrete object, see tagged
+	Type type() const noexcept { return type_; }
 	virtual std::string inspect() const = 0;
 	virtual ~object() = default;
+
+protected:
+	explicit object(Type t) noexcept: type_(t) {}
+	// a copy has no handle yet
+	object(object const& o) noexcept: type_(o.type_) {}
+
+private:
+	friend class Value;
+	std::uint8_t type_;
+	// the handles to it, see Value
+	mutable std::uint32_t refs_ = 0;
+};
+
+// base of the object of type T
+template<Type T>
+struct tagged: object {
+	static constexpr Type tag = T;
+
+	tagged() noexcept: object(T) {}
 };
 
 struct object_deleter {
 	void operator()(object* o) const
 	{
-		if (!o) return;
-
-		switch (o->type()) {
-			case BOOLEAN: [[fallthrough]];
-			case NIL: [[fallthrough]];
-			case BUILTIN:
-				return;
-			default: break;
-		}
-
-		delete o;
+		// the builtins are not on the heap
+		if (o && o->type() != BUILTIN) delete o;
 	}
 };
 
-using object_ptr = std::unique_ptr<object, object_deleter>;
-
-struct integer: object {
+// An integer out of the 63 bits of an immediate one
+struct integer: tagged<INTEGER> {
 	std::int64_t value_;
 
 	integer() = default;
 	integer(std::int64_t v): value_(v) {}
-	Type type() const override
-	{
-		return INTEGER;
-	}
 
 	std::string inspect() const override
 	{
@@ -89,50 +99,124 @@ struct integer: object {
 	}
 };
 
-struct boolean: object {
-	bool value_;
+// A value is one word. Integers, booleans and nil are immediate, in the
+// word; the other values are objects, shared by a handle counted in the
+// object: a copy is a word copy, values are shared and never cloned. The
+// count is not atomic, as a value stays in the thread evaluating it.
+//
+//   ...xxxxxxx1  integer, in the upper 63 bits
+//   ...00000010  nil
+//   ...00001010  false
+//   ...00010010  true
+//   ...xxxxx000  handle of an object, 0 for no value
+//
+// An integer too wide for 63 bits is an integer object.
+class Value {
+public:
+	Value() noexcept = default;
+	Value(std::nullptr_t) noexcept {}
+	explicit Value(object* p) noexcept: w_(reinterpret_cast<std::uintptr_t>(p)) { if (p) ++p->refs_; }
+	Value(Value const& o) noexcept: w_(o.w_) { if (o.counted()) ++o.ptr()->refs_; }
+	Value(Value&& o) noexcept: w_(std::exchange(o.w_, 0)) {}
+	// inlined even in the large loop of an engine, where most values are
+	// immediate and the test is all there is to do
+	__attribute__((always_inline)) ~Value() { if (counted() && --ptr()->refs_ == 0) object_deleter{}(ptr()); }
+
+	Value& operator=(Value o) noexcept
+	{
+		std::swap(w_, o.w_);
+		return *this;
+	}
 
-	boolean() = default;
-	boolean(bool v): value_(v) {}
-	Type type() const override
+	static Value integer(std::int64_t v)
+	{
+		if (!immediate(v)) return Value{new obj::integer{v}};
+		return word(static_cast<std::uintptr_t>(v) << 1 | int_tag);
+	}
+	// v fits in the word
+	static constexpr bool immediate(std::int64_t v) noexcept
 	{
-		return BOOLEAN;
+		return v >= -(std::int64_t{1} << 62) && v < (std::int64_t{1} << 62);
 	}
+	static Value boolean(bool v) noexcept { return word(v ? true_word : false_word); }
+	static Value nil() noexcept { return word(nil_word); }
 
-	std::string inspect() const override
+	Type type() const noexcept
 	{
-		return value_ ? "true" : "false";
+		if (w_ & int_tag) return INTEGER;
+		if (w_ & special_tag) return w_ == nil_word ? NIL : BOOLEAN;
+		return ptr()->type();
 	}
-	
-	static boolean* make(bool v)
+
+	// of an integer
+	std::int64_t as_int() const noexcept
 	{
-		static boolean t{true}, f{false};
-		return v ? &t : &f;
+		if (w_ & int_tag) return static_cast<std::int64_t>(w_) >> 1;
+		return static_cast<const obj::integer*>(ptr())->value_;
 	}
-};
+	// of a boolean
+	bool as_bool() const noexcept { return w_ == true_word; }
+
+	std::string inspect() const
+	{
+		if (w_ & int_tag) return std::to_string(as_int());
+		if (w_ & special_tag) return w_ == nil_word ? "null" : as_bool() ? "true" : "false";
+		return ptr()->inspect();
+	}
+
+	// the object, null for an immediate value
+	object* get() const noexcept { return counted() ? ptr() : nullptr; }
+	explicit operator bool() const noexcept { return w_; }
+
+	void reset(object* p = nullptr) noexcept { *this = Value{p}; }
+
+	// the word, kept out of a Value: take() gives the handle up, adopt()
+	// takes it back, share() makes another
+	std::uintptr_t take() && noexcept { return std::exchange(w_, 0); }
+	static Value adopt(std::uintptr_t w) noexcept { return word(w); }
+	static Value share(std::uintptr_t w) noexcept
+	{
+		auto v = word(w);
+		if (v.counted()) ++v.ptr()->refs_;
+		return v;
+	}
+
+	// the only handle of the object, which may then be changed in place
+	bool unique() const noexcept { return counted() && ptr()->refs_ == 1; }
 
-struct nil: object {
-	Type type() const override { return NIL; }
-	std::string inspect() const override { return "null"; }
+	// the same word: equal immediates, or the same object
+	friend bool operator==(Value const& x, Value const& y) noexcept { return x.w_ == y.w_; }
+	friend bool operator==(Value const& x, std::nullptr_t) noexcept { return !x.w_; }
 
-	static nil* make()
+private:
+	static constexpr std::uintptr_t int_tag = 1, special_tag = 2;
+	static constexpr std::uintptr_t nil_word = special_tag, false_word = 1 << 3 | special_tag,
+		true_word = 2 << 3 | special_tag;
+	static_assert(alignof(object) >= 8);
+
+	static Value word(std::uintptr_t w) noexcept
 	{
-		static nil n{};
-		return &n;
+		Value v;
+		v.w_ = w;
+		return v;
 	}
+
+	bool counted() const noexcept { return w_ && !(w_ & (int_tag | special_tag)); }
+	object* ptr() const noexcept { return reinterpret_cast<object*>(w_); }
+
+	std::uintptr_t w_ = 0;
 };
 
-#define M_NIL object_ptr{ obj::nil::make() }
-#define M_TRUE object_ptr{ obj::boolean::make(true) }
-#define M_FALSE object_ptr{ obj::boolean::make(false) }
+#define M_NIL Value::nil()
+#define M_TRUE Value::boolean(true)
+#define M_FALSE Value::boolean(false)
 
-struct return_value: object {
-	object_ptr value_;
+struct return_value: tagged<RETURN_VALUE> {
+	Value value_;
 
 	return_value() = default;
-	return_value(object_ptr&& v): value_(std::move(v)) {}
-	Type type() const override { return RETURN_VALUE; }
-	std::string inspect() const override { return value_->inspect(); }
+	return_value(Value&& v): value_(std::move(v)) {}
+	std::string inspect() const override { return value_.inspect(); }
 };
 
 enum class eval_errc {
@@ -143,9 +227,10 @@ enum class eval_errc {
 	builtin,
 	array,
 	hashtable,
+	syntax_error,
 };
 
-struct error: object, std::system_error {
+struct error: tagged<ERROR>, std::system_error {
 	static auto const& eval_category()
 	{
 		static const struct: std::error_category {
@@ -159,6 +244,7 @@ struct error: object, std::system_error {
 					case eval_errc::builtin: return "builtin";	
 					case eval_errc::array: return "array";	
 					case eval_errc::hashtable: return "hashable";	
+					case eval_errc::syntax_error: return "syntax error";
 					default: return "other error";
 				}
 			}
@@ -177,7 +263,6 @@ struct error: object, std::system_error {
 	// error(eval_errc e, const char* what_arg): std::system_error(static_cast<int>(e), eval_category(), what_arg) {}
 	error(eval_errc e, std::string const& detail):
 		std::system_error(static_cast<int>(e), eval_category()), info_(detail) {}
-	Type type() const override { return ERROR; }
 	std::string inspect() const override { return this->what(); }
 	const char* what() const noexcept override
 	{
@@ -188,9 +273,9 @@ struct error: object, std::system_error {
 		return cache_.c_str();
 	}
 
-	static object_ptr make(eval_errc e, std::string const& what_arg)
+	static Value make(eval_errc e, std::string const& what_arg)
 	{
-		return object_ptr{new error(e, what_arg)};	
+		return Value{new error(e, what_arg)};	
 	}
 };
 
@@ -198,43 +283,42 @@ template<class T>
 concept FunctionLiteral = requires(T const& t) {
 	typename T::Parameters;
 	typename T::Body;
-	{ t.parameters_ } -> std::same_as<const typename T::Parameters&>;
-	{ t.body_ } -> std::same_as<const typename T::Body&>;
+	{ t.parameters() } -> std::same_as<typename T::Parameters>;
+	{ t.body() } -> std::same_as<typename T::Body>;
+	{ t.share() } -> std::same_as<std::shared_ptr<const T>>;
+	{ t.text() } -> std::convertible_to<std::string_view>;
 	{ t.to_string() } noexcept -> std::convertible_to<std::string>;
 };
 
 template<FunctionLiteral Func, typename Env>
-struct function: object {
-	// std::shared_ptr<Func> fn_;
-	Func::Parameters parameters_;
-	Func::Body body_;
+struct function: tagged<FUNCTION> {
+	// the literal, its body may be parsed by the first call. A closure is
+	// two pointers, whatever the size of the body.
+	std::shared_ptr<const Func> fn_;
 	std::shared_ptr<Env> env_;
-	std::string ins_;
 
 	function() = default;
 	function(Func const& f, std::shared_ptr<Env> env):
-		parameters_(f.parameters_), body_(f.body_), env_(env), ins_(f.to_string())
+		fn_(f.share()), env_(env)
 	{}
 
-	Type type() const override { return FUNCTION; }
 	std::string inspect() const override
 	{
-		return ins_;
+		return std::string(fn_->text());
 	}
 };
 
-struct string: object {
+struct string: tagged<STRING> {
 	std::string value_;
 
 	string() = default;
 	string(std::string_view sv): value_(sv) {}
 	
-	Type type() const override { return STRING; }
 	std::string inspect() const override { return value_; }
 };
 
-struct array: object {
-	using Elements= std::vector<object_ptr>;
+struct array: tagged<ARRAY> {
+	using Elements= std::vector<Value>;
 	std::shared_ptr<Elements> elements_;
 	// I am lazy.
 	std::string ins_cache_;
@@ -243,22 +327,21 @@ struct array: object {
 	array(Elements&& es, std::string_view ins = "array")
 		:elements_(std::make_shared<Elements>(std::move(es))), ins_cache_(ins) {}
 
-	Type type() const override { return ARRAY; }
 	std::string inspect() const override { return ins_cache_; }
 };
 
-struct hashtable: object {
+struct hashtable: tagged<HASHTABLE> {
 	static bool hashable(Type t) {
 		return t == INTEGER || t == BOOLEAN || t == STRING;
 	}
 	struct hash {
-		std::size_t operator()(const object_ptr& o) const noexcept
+		std::size_t operator()(const Value& o) const noexcept
 		{
-			switch (o->type()) {
+			switch (o.type()) {
 				case INTEGER:
-					return std::hash<std::int64_t>{}(static_cast<const integer*>(o.get())->value_);
+					return std::hash<std::int64_t>{}(o.as_int());
 				case BOOLEAN:
-					return std::hash<bool>{}(static_cast<const boolean*>(o.get())->value_);
+					return std::hash<bool>{}(o.as_bool());
 				case STRING:
 					return std::hash<std::string>{}(static_cast<const string*>(o.get())->value_);
 				default: return -1;
@@ -266,46 +349,38 @@ struct hashtable: object {
 		}
 	};
 	struct hash_key_eq {
-		template<class T>
-			bool compare_value(object_ptr const& x, const object_ptr& y) const
-			{
-				return static_cast<const T*>(x.get())->value_ == 
-				static_cast<const T*>(y.get())->value_;
-			}
-		bool operator()(const object_ptr& x, const object_ptr& y) const
+		bool operator()(const Value& x, const Value& y) const
 		{
-			if (x.get() == y.get()) return true;
+			// equal immediates, or the same object
+			if (x == y) return true;
 			if (!x || !y) return false;
 			// x and y not null
-			if (x->type() != y->type()) return false;
-			switch (x->type()) {
+			if (x.type() != y.type()) return false;
+			switch (x.type()) {
 				case INTEGER:
-					return compare_value<integer>(x, y);
-				case BOOLEAN:
-						// for BOOLEAN, the addr is equal
-					return compare_value<boolean>(x, y);
+					return x.as_int() == y.as_int();
 				case STRING:
-					return compare_value<string>(x, y);
+					return static_cast<const string*>(x.get())->value_ ==
+						static_cast<const string*>(y.get())->value_;
 				default: return false;
 			}
 		}
 	};
 
-	using HashTable = std::unordered_map<object_ptr, object_ptr, hash, hash_key_eq>;
+	using HashTable = std::unordered_map<Value, Value, hash, hash_key_eq>;
 	std::shared_ptr<HashTable> ht_;
 
 	hashtable() = default;
 	hashtable(HashTable&& ht): ht_(std::make_shared<HashTable>(move(ht))) {}
 
-	Type type() const override { return HASHTABLE; }
 	std::string inspect() const override
 	{
 		std::ostringstream out;
 		out << "{";
 		if (ht_) {
 			for (auto const&[k, v]: *ht_) {
-				out << "\n  " << k->inspect() << ": " << looktype(k->type()) << " -> "
-					<< v->inspect() << " : " << looktype(v->type());
+				out << "\n  " << k.inspect() << ": " << looktype(k.type()) << " -> "
+					<< v.inspect() << " : " << looktype(v.type());
 			}
 			out << "\n";
 		}
@@ -314,60 +389,61 @@ struct hashtable: object {
 	}
 };
 
-struct builtin: object {
-	using builtinFuncArg = std::vector<object_ptr>;
-	using builtinFunc = object_ptr(*)(builtinFuncArg);
+struct builtin: tagged<BUILTIN> {
+	using builtinFuncArg = std::vector<Value>;
+	using builtinFunc = Value(*)(builtinFuncArg);
 	builtinFunc fn_;
 	
 	builtin() = default;
 	builtin(builtinFunc fn): fn_(fn) {}
 
 
-	Type type() const override { return BUILTIN; }
 	std::string inspect() const override { return ""; }
 
-	static std::unordered_map<std::string, builtin> create_builtins()
+	// a resolved identifier of a builtin is its index
+	using Builtins = std::vector<std::pair<symbol::id, builtin>>;
+	static Builtins create_builtins()
 	{
-		std::unordered_map<std::string, builtin> builtins;
-		builtins.emplace("len", len);
-		builtins.emplace("append", append);
-		builtins.emplace("println", println);
-		return builtins;
+		return {
+			{symbol::intern("len"), len},
+			{symbol::intern("append"), append},
+			{symbol::intern("println"), println},
+		};
 	}
 
-	static object_ptr len(builtinFuncArg args)
+	static Value len(builtinFuncArg args)
 	{
 		if (args.size() != 1)
 			return error::make(eval_errc::builtin, "len: wrong arg size: " + std::to_string(args.size()));
-		switch (args[0]->type()) {
-			case STRING: return object_ptr{new integer(
-											 static_cast<string*>(args[0].get())->value_.length()
-											 )};
-			case ARRAY: return object_ptr{new integer(
-											static_cast<array*>(args[0].get())->elements_->size()
-											)};
-			default: return error::make(eval_errc::builtin, "len: not supported type " + std::to_string(args[0]->type()));
+		switch (args[0].type()) {
+			case STRING: return Value::integer(
+										  static_cast<string*>(args[0].get())->value_.length()
+										  );
+			case ARRAY: return Value::integer(
+										 static_cast<array*>(args[0].get())->elements_->size()
+										 );
+			default: return error::make(eval_errc::builtin, "len: not supported type " + std::to_string(args[0].type()));
 		}
 	}
 
-	static object_ptr append(builtinFuncArg args)
+	static Value append(builtinFuncArg args)
 	{
 		if (args.size() != 2)
 			return error::make(eval_errc::builtin, "append: wrong arg size: " + std::to_string(args.size()));
-		if (auto* arr = dynamic_cast<array*>(args[0].get()); arr) {
-			arr->elements_->push_back(std::move(args[1]));
+		if (args[0].type() == ARRAY) {
+			static_cast<array*>(args[0].get())->elements_->push_back(std::move(args[1]));
 			return std::move(args[0]);
 		}
-		return error::make(eval_errc::builtin, "append: not an array"  + args[0]->inspect());
+		return error::make(eval_errc::builtin, "append: not an array"  + args[0].inspect());
 	}
 
-	static object_ptr println(builtinFuncArg args)
+	static Value println(builtinFuncArg args)
 	{
 		std::cout << "[monkey]";
 		for (auto const& arg: args)
-			std::cout << arg->inspect() << ' ';
+			std::cout << arg.inspect() << ' ';
 		std::cout << '\n';
-		return object_ptr{ nil::make() };
+		return Value::nil();
 	}
 }; // struct builtin
 
@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ast/ast.hpp"
+#include "object/object.hpp"
+
+namespace vm {
+
+// An instruction is an opcode and its operands, inline after it. The
+// operands are u32 unless said, in the byte order of the host.
+//
+//   opcode       operands                  stack
+//   constant     constant                  -> constants[constant]
+//   nil                                    -> null
+//   pop                                    value ->
+//   get_local    u16 depth, slot, ident    -> slot of the frame depth up
+//   get_global   symbol                    -> global
+//   get_builtin  builtin                   -> builtin
+//   undefined    ident                     fails, the name is missing
+//   set_local    slot                      value -> value
+//   set_global   symbol                    value -> value
+//   prefix       u8 op                     right -> result
+//   infix        u8 op                     left, right -> result
+//   jump         target
+//   jump_false   target                    cond ->
+//   array        count, text               elements... -> array
+//   hash         pairs                     key, value... -> hashtable
+//   index                                  set, index -> element
+//   closure      function                  -> function value
+//   call         argc, site                fn, args... -> result
+//   ret                                    value ->
+//
+// A target is an offset in the code of the chunk. ident indexes the
+// identifiers of the chunk, only read for an unset slot: for where else the
+// name is, or the message of the error. site indexes the call sites of the
+// chunk.
+enum class Opcode: std::uint8_t {
+	constant,
+	nil,
+	pop,
+	get_local,
+	get_global,
+	get_builtin,
+	undefined,
+	set_local,
+	set_global,
+	prefix,
+	infix,
+	jump,
+	jump_false,
+	array,
+	hash,
+	index,
+	closure,
+	call,
+	ret,
+};
+
+// the function a call last called, and its code
+struct call_site {
+	const ast::FunctionLiteral* fn = nullptr;
+	const struct chunk* code = nullptr;
+};
+
+// the code of a program or of a function body
+struct chunk {
+	std::vector<std::uint8_t> code;
+	std::vector<obj::Value> constants;
+	// of closure, kept alive by the program or the function values
+	std::vector<const ast::FunctionLiteral*> functions;
+	std::vector<const ast::Identifier*> idents;
+	// inspect() of the array literals
+	std::vector<std::string> texts;
+	// filled by the machine as it runs the calls
+	mutable std::vector<call_site> sites;
+
+	std::size_t size() const noexcept { return code.size(); }
+
+	void emit(Opcode op) { code.push_back(static_cast<std::uint8_t>(op)); }
+
+	template<class T>
+	void put(T v)
+	{
+		auto at = code.size();
+		code.resize(at + sizeof(T));
+		std::memcpy(code.data() + at, &v, sizeof(T));
+	}
+
+	// the operand of a jump, for patch()
+	std::size_t jump(Opcode op)
+	{
+		emit(op);
+		put<std::uint32_t>(0);
+		return code.size() - sizeof(std::uint32_t);
+	}
+
+	// the jump at operand goes here
+	void patch(std::size_t operand)
+	{
+		auto target = static_cast<std::uint32_t>(code.size());
+		std::memcpy(code.data() + operand, &target, sizeof(target));
+	}
+};
+
+// reads an operand, and moves ip past it
+template<class T>
+inline T read(const std::uint8_t*& ip) noexcept
+{
+	T v;
+	std::memcpy(&v, ip, sizeof(T));
+	ip += sizeof(T);
+	return v;
+}
+
+}
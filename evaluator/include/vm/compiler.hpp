@@ -0,0 +1,215 @@
+#pragma once
+#include "ast/ast.hpp"
+#include "eval/literal.hpp"
+#include "vm/code.hpp"
+
+namespace vm {
+
+// Compiles a resolved program, or a resolved function body, into a chunk.
+// Every statement leaves its value, which the next one pops: the value of
+// a block is the one of its last statement, nil for an empty block. The
+// nested function literals are compiled by their first call.
+class compiler {
+public:
+	static chunk program(const ast::Program* program)
+	{
+		compiler c;
+		c.block(program->statements);
+		c.out_.emit(Opcode::ret);
+		return std::move(c.out_);
+	}
+
+	static chunk function(const ast::BlockStmt* body)
+	{
+		compiler c;
+		c.block(body->statements_);
+		c.out_.emit(Opcode::ret);
+		return std::move(c.out_);
+	}
+
+private:
+	void block(ast::Statements const& stmts)
+	{
+		if (stmts.empty()) {
+			out_.emit(Opcode::nil);
+			return;
+		}
+		for (std::size_t i = 0; i < stmts.size(); ++i) {
+			if (i) out_.emit(Opcode::pop);
+			stmt(stmts[i].get());
+		}
+	}
+
+	void block(const ast::BlockStmt* b)
+	{
+		if (b) block(b->statements_);
+		else out_.emit(Opcode::nil);
+	}
+
+	void stmt(const ast::Statement* s)
+	{
+		if (!s) {
+			out_.emit(Opcode::nil);
+			return;
+		}
+		switch (s->kind_) {
+			case ast::Kind::let: {
+				auto* l = static_cast<const ast::LetStmt*>(s);
+				expr(l->value_.get());
+				auto const& a = l->name_->addr_;
+				out_.emit(a.scope == ast::Address::local ? Opcode::set_local : Opcode::set_global);
+				out_.put(a.slot);
+				break;
+			}
+			case ast::Kind::ret:
+				expr(static_cast<const ast::ReturnStmt*>(s)->return_value_.get());
+				out_.emit(Opcode::ret);
+				break;
+			case ast::Kind::expr_stmt:
+				expr(static_cast<const ast::ExpressionStmt*>(s)->expression_.get());
+				break;
+			case ast::Kind::block:
+				block(static_cast<const ast::BlockStmt*>(s));
+				break;
+			default:
+				out_.emit(Opcode::nil);
+				break;
+		}
+	}
+
+	void expr(const ast::Expression* e)
+	{
+		if (!e) {
+			out_.emit(Opcode::nil);
+			return;
+		}
+		switch (e->kind_) {
+			case ast::Kind::ident:
+				ident(static_cast<const ast::Identifier*>(e));
+				break;
+			case ast::Kind::integer:
+				constant(evaluator::literal(static_cast<const ast::IntegerLiteral*>(e)));
+				break;
+			case ast::Kind::boolean:
+				constant(obj::Value::boolean(static_cast<const ast::Boolean*>(e)->value_));
+				break;
+			case ast::Kind::string:
+				constant(evaluator::literal(static_cast<const ast::StringLiteral*>(e)));
+				break;
+			case ast::Kind::prefix: {
+				auto* p = static_cast<const ast::PrefixExpression*>(e);
+				expr(p->right_.get());
+				out_.emit(Opcode::prefix);
+				out_.put(p->op_);
+				break;
+			}
+			case ast::Kind::infix: {
+				auto* i = static_cast<const ast::InfixExpression*>(e);
+				expr(i->left_.get());
+				expr(i->right_.get());
+				out_.emit(Opcode::infix);
+				out_.put(i->op_);
+				break;
+			}
+			case ast::Kind::if_expr: {
+				auto* i = static_cast<const ast::IfExpression*>(e);
+				expr(i->cond_.get());
+				auto otherwise = out_.jump(Opcode::jump_false);
+				block(i->consequence_.get());
+				auto end = out_.jump(Opcode::jump);
+				out_.patch(otherwise);
+				block(i->alternative_.get());
+				out_.patch(end);
+				break;
+			}
+			case ast::Kind::function:
+				out_.emit(Opcode::closure);
+				out_.put(index(out_.functions, static_cast<const ast::FunctionLiteral*>(e)));
+				break;
+			case ast::Kind::call: {
+				auto* c = static_cast<const ast::CallExpression*>(e);
+				expr(c->fn_.get());
+				for (auto const& arg: c->args_) expr(arg.get());
+				out_.emit(Opcode::call);
+				out_.put(static_cast<std::uint32_t>(c->args_.size()));
+				out_.put(static_cast<std::uint32_t>(out_.sites.size()));
+				out_.sites.emplace_back();
+				break;
+			}
+			case ast::Kind::array: {
+				auto* a = static_cast<const ast::ArrayLiteral*>(e);
+				for (auto const& elem: a->elements_) expr(elem.get());
+				out_.emit(Opcode::array);
+				out_.put(static_cast<std::uint32_t>(a->elements_.size()));
+				out_.put(index(out_.texts, a->to_string()));
+				break;
+			}
+			case ast::Kind::index: {
+				auto* i = static_cast<const ast::IndexExpression*>(e);
+				expr(i->left_.get());
+				expr(i->index_.get());
+				out_.emit(Opcode::index);
+				break;
+			}
+			case ast::Kind::hash: {
+				auto* h = static_cast<const ast::HashTableLiteral*>(e);
+				if (auto v = evaluator::literal(h)) {
+					constant(std::move(v));
+					break;
+				}
+				for (auto const& [k, v]: h->pairs_) {
+					expr(k.get());
+					expr(v.get());
+				}
+				out_.emit(Opcode::hash);
+				out_.put(static_cast<std::uint32_t>(h->pairs_.size()));
+				break;
+			}
+			default:
+				out_.emit(Opcode::nil);
+				break;
+		}
+	}
+
+	void ident(const ast::Identifier* i)
+	{
+		auto const& a = i->addr_;
+		switch (a.scope) {
+			case ast::Address::local:
+				out_.emit(Opcode::get_local);
+				out_.put(a.depth);
+				out_.put(a.slot);
+				out_.put(index(out_.idents, i));
+				break;
+			case ast::Address::global:
+				out_.emit(Opcode::get_global);
+				out_.put(a.slot);
+				break;
+			case ast::Address::builtin:
+				out_.emit(Opcode::get_builtin);
+				out_.put(a.slot);
+				break;
+			default:
+				out_.emit(Opcode::undefined);
+				out_.put(index(out_.idents, i));
+				break;
+		}
+	}
+
+	void constant(obj::Value v)
+	{
+		out_.emit(Opcode::constant);
+		out_.put(index(out_.constants, std::move(v)));
+	}
+
+	template<class T, class V>
+	static std::uint32_t index(std::vector<T>& table, V&& v)
+	{
+		table.push_back(std::forward<V>(v));
+		return static_cast<std::uint32_t>(table.size() - 1);
+	}
+
+	chunk out_;
+};
+
+}
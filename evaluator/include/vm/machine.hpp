@@ -0,0 +1,270 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ast/ast.hpp"
+#include "object/object.hpp"
+#include "object/env.hpp"
+#include "eval/ops.hpp"
+#include "eval/resolve.hpp"
+#include "vm/code.hpp"
+#include "vm/compiler.hpp"
+
+namespace vm {
+
+// A stack machine running the chunks of the compiler, the other engine
+// next to evaluator::eval_handler. Its values, environments and errors
+// are those of the evaluator, so both give the same results.
+//
+// Calls do not recurse on the C++ stack: a call pushes a frame, ret pops
+// it. A function body is resolved, if lazy, and compiled by its first
+// call, then kept as long as the machine.
+class machine {
+public:
+	using Ret = obj::Value;
+	using Env = obj::environment;
+	using EnvPtr = std::shared_ptr<Env>;
+	using func = obj::function<ast::FunctionLiteral, obj::environment>;
+
+	// as an EvalHandler of evaluator::eval<>, a machine for each program
+	static obj::Value eval(const ast::Program* program, EnvPtr env)
+	{
+		machine m;
+		return m.run(program, std::move(env));
+	}
+
+	obj::Value run(const ast::Program* program, EnvPtr env)
+	{
+		if (auto missing = evaluator::resolve(program, *env, builtins)) return missing;
+		if (program->statements.empty()) return nullptr;
+		auto code = compiler::program(program);
+		return execute(&code, std::move(env));
+	}
+
+private:
+	using e = obj::eval_errc;
+	using err = obj::error;
+
+	struct frame {
+		const chunk* code;
+		// of the next instruction, while a callee runs
+		std::size_t ip;
+		EnvPtr env;
+		// height of the stack at the call
+		std::size_t base;
+	};
+
+	obj::Value execute(const chunk* entry, EnvPtr env)
+	{
+		const auto frames = frames_.size(), base = stack_.size();
+		frames_.push_back({entry, 0, std::move(env), base});
+		// the top frame, reloaded by call and ret
+		const chunk* c;
+		const std::uint8_t* ip;
+		Env* scope;
+		auto load = [&] {
+			auto& f = frames_.back();
+			c = f.code;
+			ip = c->code.data() + f.ip;
+			scope = f.env.get();
+		};
+		// ends the run with an error
+		auto fail = [&](obj::Value error) {
+			frames_.resize(frames);
+			stack_.resize(base);
+			return error;
+		};
+		load();
+
+		for (;;) {
+			switch (static_cast<Opcode>(*ip++)) {
+				case Opcode::constant:
+					stack_.push_back(c->constants[read<std::uint32_t>(ip)]);
+					break;
+				case Opcode::nil:
+					stack_.push_back(obj::M_NIL);
+					break;
+				case Opcode::pop:
+					stack_.pop_back();
+					break;
+				case Opcode::get_local: {
+					auto depth = read<std::uint16_t>(ip);
+					auto slot = read<std::uint32_t>(ip);
+					auto ident = read<std::uint32_t>(ip);
+					if (auto* v = scope->frame(depth).slot(slot)) {
+						stack_.push_back(*v);
+						break;
+					}
+					auto* i = c->idents[ident];
+					auto around = evaluator::unset(*scope, i->addr_, builtins);
+					// read before its let
+					if (!around) return fail(err::make(e::identifier_not_defined, std::string(i->name())));
+					stack_.push_back(std::move(around));
+					break;
+				}
+				case Opcode::get_global: {
+					auto sym = read<std::uint32_t>(ip);
+					auto* v = scope->globals().slot(sym);
+					if (!v) return fail(err::make(e::identifier_not_defined, std::string(symbol::name(sym))));
+					stack_.push_back(*v);
+					break;
+				}
+				case Opcode::get_builtin:
+					stack_.emplace_back(&builtins[read<std::uint32_t>(ip)].second);
+					break;
+				case Opcode::undefined:
+					return fail(err::make(e::identifier_not_defined,
+								std::string(c->idents[read<std::uint32_t>(ip)]->name())));
+				case Opcode::set_local:
+					scope->bind(read<std::uint32_t>(ip), stack_.back());
+					break;
+				case Opcode::set_global:
+					scope->set(read<std::uint32_t>(ip), stack_.back());
+					break;
+				case Opcode::prefix: {
+					auto op = read<ast::Op>(ip);
+					auto r = evaluator::ops::prefix(op, std::move(stack_.back()));
+					if (r.type() == obj::ERROR) return fail(std::move(r));
+					stack_.back() = std::move(r);
+					break;
+				}
+				case Opcode::infix: {
+					auto op = read<ast::Op>(ip);
+					auto right = std::move(stack_.back());
+					stack_.pop_back();
+					auto r = evaluator::ops::infix(op, std::move(stack_.back()), std::move(right));
+					if (r.type() == obj::ERROR) return fail(std::move(r));
+					stack_.back() = std::move(r);
+					break;
+				}
+				case Opcode::jump:
+					ip = c->code.data() + read<std::uint32_t>(ip);
+					break;
+				case Opcode::jump_false: {
+					auto target = read<std::uint32_t>(ip);
+					if (!evaluator::ops::truthy(stack_.back()))
+						ip = c->code.data() + target;
+					stack_.pop_back();
+					break;
+				}
+				case Opcode::array: {
+					auto n = read<std::uint32_t>(ip);
+					auto text = read<std::uint32_t>(ip);
+					obj::array::Elements elems(std::make_move_iterator(stack_.end() - n), std::make_move_iterator(stack_.end()));
+					stack_.resize(stack_.size() - n);
+					stack_.emplace_back(new obj::array(std::move(elems), c->texts[text]));
+					break;
+				}
+				case Opcode::hash: {
+					auto n = read<std::uint32_t>(ip);
+					obj::hashtable::HashTable ht;
+					for (auto it = stack_.end() - 2 * n; it != stack_.end(); it += 2)
+						ht.emplace(std::move(it[0]), std::move(it[1]));
+					stack_.resize(stack_.size() - 2 * n);
+					stack_.emplace_back(new obj::hashtable{std::move(ht)});
+					break;
+				}
+				case Opcode::index: {
+					auto key = std::move(stack_.back());
+					stack_.pop_back();
+					auto r = evaluator::ops::index(stack_.back(), key);
+					if (r.type() == obj::ERROR) return fail(std::move(r));
+					stack_.back() = std::move(r);
+					break;
+				}
+				case Opcode::closure:
+					stack_.emplace_back(new func{*c->functions[read<std::uint32_t>(ip)], frames_.back().env});
+					break;
+				case Opcode::call: {
+					auto argc = read<std::uint32_t>(ip);
+					auto& site = c->sites[read<std::uint32_t>(ip)];
+					auto args = stack_.end() - argc;
+					auto fn = args[-1];
+					if (fn.type() == obj::BUILTIN) {
+						obj::builtin::builtinFuncArg list(std::make_move_iterator(args), std::make_move_iterator(stack_.end()));
+						stack_.resize(stack_.size() - argc - 1);
+						auto r = static_cast<obj::builtin*>(fn.get())->fn_(std::move(list));
+						if (r.type() == obj::ERROR) return fail(std::move(r));
+						stack_.push_back(std::move(r));
+						break;
+					}
+					if (fn.type() != obj::FUNCTION)
+						return fail(err::make(e::not_a_function, fn.inspect()));
+
+					auto* f = static_cast<func*>(fn.get());
+					// most call sites call a single function
+					if (site.fn != f->fn_.get()) {
+						auto* code = code_of(f);
+						if (!code) return fail(err::make(e::syntax_error, std::string(f->fn_->error())));
+						site = {f->fn_.get(), code};
+					}
+					auto* code = site.code;
+					auto callee = frame_for(f);
+					auto const& params = f->fn_->parameters_;
+					for (std::size_t i = 0; i < argc && i < params.size(); ++i)
+						callee->bind(params[i]->addr_.slot, std::move(args[i]));
+					stack_.resize(stack_.size() - argc - 1);
+					frames_.back().ip = ip - c->code.data();
+					frames_.push_back({code, 0, std::move(callee), stack_.size()});
+					load();
+					break;
+				}
+				case Opcode::ret: {
+					auto v = std::move(stack_.back());
+					stack_.resize(frames_.back().base);
+					// the frame of a call, not the one run() was given
+					if (auto& done = frames_.back().env; frames_.size() > frames + 1) {
+						done->collect<func>(done.use_count());
+						// a frame no function value kept is spare for the next call
+						if (done.use_count() == 1) {
+							done->release();
+							spare_.push_back(std::move(done));
+						}
+					}
+					frames_.pop_back();
+					if (frames_.size() == frames) return v;
+					stack_.push_back(std::move(v));
+					load();
+					break;
+				}
+			}
+		}
+	}
+
+	// the frame of a call of f, a spare one if any
+	EnvPtr frame_for(func* f)
+	{
+		if (spare_.empty()) return std::make_shared<Env>(f->env_, f->fn_->frame_size_);
+		auto env = std::move(spare_.back());
+		spare_.pop_back();
+		env->reuse(f->env_, f->fn_->frame_size_);
+		return env;
+	}
+
+	// the chunk of the body of f, null for a syntax error in it
+	const chunk* code_of(func* f)
+	{
+		auto* lit = f->fn_.get();
+		if (auto it = code_.find(lit); it != code_.end())
+			return &it->second.second;
+		auto* body = lit->block();
+		if (!body) return nullptr;
+		if (!lit->resolved_)
+			evaluator::resolver{*f->env_, builtins}.resolve_body(lit);
+		// the literal is kept, so its address is not reused by another
+		auto [it, _] = code_.emplace(lit, std::pair{f->fn_, compiler::function(body)});
+		return &it->second.second;
+	}
+
+	static inline obj::builtin::Builtins builtins = obj::builtin::create_builtins();
+
+	std::vector<obj::Value> stack_;
+	std::vector<frame> frames_;
+	std::vector<EnvPtr> spare_;
+	std::unordered_map<const ast::FunctionLiteral*, std::pair<std::shared_ptr<const ast::FunctionLiteral>, chunk>> code_;
+};
+
+}
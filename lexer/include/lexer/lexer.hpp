@@ -1,22 +1,44 @@
 #pragma once
 #include <string>
-#include <cctype>
+#include <string_view>
+#include <type_traits>
 #include "token.hpp"
+#include "scan.hpp"
 
 namespace lexer {
 
+// tag for a Lexer which views the source instead of copying it,
+// the source must outlive the lexer and every token it returns
+struct borrow_t { explicit borrow_t() = default; };
+inline constexpr borrow_t borrow{};
+
 class Lexer {
 public:
 	Lexer() = default;
 
-	Lexer(std::string const& _input): input(_input) {
+	// copy the input, tokens are valid as long as the lexer is
+	constexpr Lexer(std::string const& _input): owned_(_input), input(owned_) {
+		if (!std::is_constant_evaluated())
+			kernels_ = &scan::active();
 		position = 0;
 		read_position = 0;
 		// read first char
 		read();
 	}
 
-	token::Token next_token() {
+	constexpr Lexer(std::string_view source, borrow_t): input(source) {
+		if (!std::is_constant_evaluated())
+			kernels_ = &scan::active();
+		position = 0;
+		read_position = 0;
+		read();
+	}
+
+	// input may view owned_
+	Lexer(Lexer const&) = delete;
+	Lexer& operator=(Lexer const&) = delete;
+
+	constexpr token::Token next_token() {
 		token::Token t;
 
 		skip_whitespace();
@@ -25,7 +47,7 @@ public:
 			case '=': 
 				if (peek() == '=') {
 					read(); // the first '='
-					t = token::Token{token::EQ, "=="};
+					t = token::Token{token::EQ, input.substr(position - 1, 2)};
 				}
 				else t = make_token(token::ASSIGN, ch);
 				break;
@@ -53,7 +75,7 @@ public:
 			case '!':
 				if (peek() == '=') {
 					read(); // '!'
-					t = token::Token{token::NEQ, "!="};
+					t = token::Token{token::NEQ, input.substr(position - 1, 2)};
 				}
 				else t = make_token(token::BANG, ch);
 				break;
@@ -84,22 +106,22 @@ public:
 			case '"':
 				// TODO support for escapte char ..
 				read(); // for eat the first '"'
-				t = token::Token{token::STRING, read_ident_or_num([](char ch) -> bool {
-						return ch != '"' && ch != 0;
-						})};
+				t = token::Token{token::STRING, read_run(scan::string_body)};
 				break;
 			case 0:
 				t = make_token(token::END_OF_FILE, ch);
 				break;
 			default:
-				if (is_letter(ch)) {
+				if (scan::is(ch, scan::letter)) {
 					// NOTE return from there, avoid read() repeatedly
-					auto literal = read_ident_or_num(is_letter);
-					return token::Token{token::lookup_ident(literal), literal};
-				} else if (isdigit(static_cast<unsigned char>(ch))) {
-					return token::Token{token::INT, read_ident_or_num([](char ch) -> bool {
-							return isdigit(static_cast<unsigned char>(ch));
-							})};
+					auto literal = read_run(scan::letter);
+					auto type = token::lookup_ident(literal);
+					// the symbol table is not constexpr, nor needed there
+					if (type == token::IDENT && !std::is_constant_evaluated())
+						return token::Token{type, literal, symbol::intern(literal)};
+					return token::Token{type, literal};
+				} else if (scan::is(ch, scan::digit)) {
+					return token::Token{token::INT, read_run(scan::digit)};
 				}
 				else {
 					t = make_token(token::ILLEGAL, ch);
@@ -110,9 +132,47 @@ public:
 		return t;
 	}
 
+	// for skipping a block without lexing it, see match_brace()
+
+	// the offset in the input of a token of this lexer, but END_OF_FILE
+	constexpr std::size_t offset(token::Token const& t) const noexcept
+	{
+		return static_cast<std::size_t>(t.literal.data() - input.data());
+	}
+
+	// the offset of the '}' closing the '{' at input[open], npos if the
+	// input ends first. Strings are the only tokens which may hold a brace,
+	// the rest needs no lexing.
+	constexpr std::size_t match_brace(std::size_t open) const noexcept
+	{
+		int depth = 0;
+		for (std::size_t i = open, n = input.length(); i < n; ++i) {
+			switch (input[i]) {
+				case '{':
+					++depth;
+					break;
+				case '}':
+					if (--depth == 0) return i;
+					break;
+				case '"':
+					for (++i; i < n && input[i] != '"'; ++i) {}
+					break;
+			}
+		}
+		return std::string_view::npos;
+	}
+
+	// the next token starts at input[pos]
+	constexpr void rewind(std::size_t pos) noexcept
+	{
+		seek(pos);
+	}
+
+	constexpr std::string_view source() const noexcept { return input; }
+
 
 private:
-	void read() noexcept {
+	constexpr void read() noexcept {
 		// must: >=
 		if (read_position >= input.length()) ch = 0;
 		else ch = input[read_position];
@@ -121,47 +181,64 @@ private:
 		++read_position;
 	}
 
-	// construct token by a single char
-	token::Token make_token(token::TokenType const& tt, char c) const noexcept 
+	// construct token by the current char, which is empty at the end of input
+	constexpr token::Token make_token(token::TokenType tt, char) const noexcept 
 	{
-		std::string s(1, c);
-		return token::Token{tt, s};
+		if (position >= input.length()) return token::Token{tt, {}};
+		return token::Token{tt, input.substr(position, 1)};
 	}
 
-	// is a valid letter for indetifier or not
-	static bool is_letter(char ch) noexcept {
-		return (ch >= 'A' && ch <= 'Z') 
-			|| (ch >= 'a' && ch <= 'z')
-			|| ch == '_';
+	// move to input[pos], as if read() until there
+	constexpr void seek(std::size_t pos) noexcept {
+		read_position = pos;
+		read();
 	}
 
-	// read from current position, until the next position which check(next position) == false
-	std::string read_ident_or_num(bool (*check)(char)) {
-		int beg = position;
-		// do while cannot deal empty string
-		// do {
-		//   read();
-		// } while (check(ch));
-		while (check(ch)) read();
+	// read from current position, until the first char which is not k
+	constexpr std::string_view read_run(scan::cls k) noexcept {
+		auto beg = position;
+		if (position >= input.length()) return {};
+
+		auto* first = input.data();
+		auto* last = first + input.length();
+		// most runs are short, the table is faster than calling a kernel for them
+		auto* p = first + position;
+		auto* near = last - p > 16 ? p + 16 : last;
+		p = scan::skip(p, near, k);
+		// the kernels are not constexpr
+		if (p == near && near != last && !std::is_constant_evaluated()) {
+			auto fn = k == scan::space ? kernels_->skip_space :
+				k == scan::letter ? kernels_->skip_letters :
+				k == scan::digit ? kernels_->skip_digits : kernels_->skip_string_body;
+			p = fn(p, last);
+		} else if (p == near) {
+			p = scan::skip(p, last, k);
+		}
+		seek(static_cast<std::size_t>(p - first));
 		return input.substr(beg, position - beg);
 	}
 
-	void skip_whitespace() {
-		while (ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r')
-			read();
+	constexpr void skip_whitespace() {
+		// most tokens are apart by a single space
+		if (scan::is(ch, scan::space))
+			read_run(scan::space);
 	}
 
-	char peek() const noexcept {
+	constexpr char peek() const noexcept {
 		if (read_position == input.length()) return 0;
 		return input[read_position];
 	}
 
-	std::string input;
+	// storage for a copied input, unused when borrowing
+	std::string owned_;
+	std::string_view input;
 	// current position of input
-	int position;
-	int read_position;
+	std::size_t position = 0;
+	std::size_t read_position = 0;
 	// TODO more type, using template and concept
-	char ch;
+	char ch = 0;
+	// for the long runs, only null in constant evaluation
+	scan::kernels const* kernels_ = nullptr;
 };
 
 
@@ -0,0 +1,61 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// Scanning kernels used by the lexer to find the end of a run of chars,
+// such as whitespace, identifiers, numbers and string bodies.
+namespace lexer::scan {
+
+enum cls: std::uint8_t {
+	space = 1, // ' ', '\n', '\t', '\r'
+	letter = 2, // [A-Za-z_]
+	digit = 4, // [0-9]
+	string_body = 8, // all but '"' and '\0'
+};
+
+// char -> cls mask
+constexpr std::array<std::uint8_t, 256> classes = [] {
+	std::array<std::uint8_t, 256> table{};
+	for (int c = 0; c < 256; ++c) {
+		std::uint8_t m = 0;
+		if (c == ' ' || c == '\n' || c == '\t' || c == '\r') m |= space;
+		if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_') m |= letter;
+		if (c >= '0' && c <= '9') m |= digit;
+		if (c != '"' && c != 0) m |= string_body;
+		table[c] = m;
+	}
+	return table;
+}();
+
+constexpr bool is(char c, cls k) noexcept
+{
+	return classes[static_cast<unsigned char>(c)] & k;
+}
+
+// the first char in [p, end) which is not k, or end
+constexpr const char* skip(const char* p, const char* end, cls k) noexcept
+{
+	while (p != end && is(*p, k)) ++p;
+	return p;
+}
+
+// a set of kernels, each returns the end of the run starting at p
+struct kernels {
+	using Fn = const char* (*)(const char* p, const char* end) noexcept;
+	const char* name;
+	Fn skip_space;
+	Fn skip_letters;
+	Fn skip_digits;
+	Fn skip_string_body;
+};
+
+// the 256-entry table loop, always available
+kernels const& scalar() noexcept;
+// nullptr when the cpu (or the target) does not support it
+kernels const* sse2() noexcept;
+kernels const* avx2() noexcept;
+
+// the widest kernels supported by this cpu, selected at the first call
+kernels const& active() noexcept;
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include "token.hpp"
+
+namespace lexer {
+
+// A lexer which pulls the source from a std::istream or a file descriptor
+// through a fixed size buffer, so the memory it uses does not grow with the
+// input. It produces the same tokens as Lexer.
+//
+// The literal of a token is valid until three more tokens are returned,
+// which is enough for the lookahead of the parser.
+class StreamLexer {
+public:
+	static constexpr std::size_t default_capacity = 64 * 1024;
+
+	StreamLexer() = default;
+	// the stream or fd is not owned and must outlive the lexer
+	explicit StreamLexer(std::istream& in, std::size_t capacity = default_capacity);
+	explicit StreamLexer(int fd, std::size_t capacity = default_capacity);
+
+	token::Token next_token();
+
+private:
+	StreamLexer(std::size_t capacity);
+
+	// make sure at least n chars are buffered unless the input ends, false if not
+	bool fill(std::size_t n);
+	// the read from the source, 0 at the end of input
+	std::size_t read_some(char* buf, std::size_t n);
+
+	char cur() { return fill(1) ? buf_[pos_] : 0; }
+	char peek() { return fill(2) ? buf_[pos_ + 1] : 0; }
+	void advance() { if (fill(1)) ++pos_; }
+
+	// consume the run of k from the current char, append it to out if not null
+	void read_run(std::uint8_t k, std::string* out);
+	// a slot for the literal of the next token
+	std::string& literal_slot();
+
+	std::istream* in_ = nullptr;
+	int fd_ = -1;
+	bool eof_ = true;
+
+	std::unique_ptr<char[]> buf_;
+	std::size_t capacity_ = 0;
+	// buffered chars are [pos_, end_)
+	std::size_t pos_ = 0;
+	std::size_t end_ = 0;
+
+	std::array<std::string, 4> literals_;
+	std::size_t next_literal_ = 0;
+};
+
+}
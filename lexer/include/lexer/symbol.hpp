@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+// Interned identifier names. Every distinct name is stored once and has a
+// stable id, so names compare and hash as integers.
+namespace symbol {
+
+using id = std::uint32_t;
+
+// the id of no name, never returned by intern()
+constexpr id none = 0;
+
+// the id of name, the same for every call with the same name, thread safe
+id intern(std::string_view name);
+
+// the name of an interned id, valid until the program exits
+std::string_view name(id s);
+
+}
@@ -1,57 +1,251 @@
 #pragma once
-#include <string>
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <string_view>
+#include "symbol.hpp"
 
 namespace token {
 
-using TokenType = std::string;
+enum class TokenType: std::uint8_t {
+	ILLEGAL,
+	END_OF_FILE,
 
+	IDENT,
+	INT,
+
+	ASSIGN,
+	PLUS,
+	MINUS,
+	BANG,
+	ASTERISK,
+	SLASH,
+	LT,
+	GT,
+	EQ,
+	NEQ,
+
+	COMMA,
+	SEMICOLON,
+	COLON,
+
+	LPAREN,
+	RPAREN,
+	LBRACKET,
+	RBRACKET,
+	LBRACE,
+	RBRACE,
+
+	// key word
+	FUNCTION,
+	LET,
+	TRUE,
+	FALSE,
+	IF,
+	ELSE,
+	RETURN,
+
+	STRING,
+};
+
+// number of token types, the size of tables indexed by TokenType
+constexpr std::size_t count = static_cast<std::size_t>(TokenType::STRING) + 1;
+
+constexpr std::size_t index(TokenType t) noexcept
+{
+	return static_cast<std::size_t>(t);
+}
+
+// literal is a view of the source text, it is valid as long as the source is
 struct Token {
 	TokenType token_type;
-	std::string literal;
+	std::string_view literal;
+	// interned literal of IDENT, none for the other types
+	symbol::id sym = symbol::none;
 };
 
-const TokenType ILLEGAL = "ILLEGAL";
-const TokenType END_OF_FILE = "EOF";
+constexpr TokenType ILLEGAL = TokenType::ILLEGAL;
+constexpr TokenType END_OF_FILE = TokenType::END_OF_FILE;
 
-const TokenType IDENT = "IDENT";
-const TokenType INT = "INT";
+constexpr TokenType IDENT = TokenType::IDENT;
+constexpr TokenType INT = TokenType::INT;
 
-const TokenType ASSIGN = "=";
-const TokenType PLUS = "+";
-const TokenType MINUS = "-";
-const TokenType BANG = "!";
-const TokenType ASTERISK = "*";
-const TokenType SLASH = "/";
-const TokenType LT = "<";
-const TokenType GT = ">";
-const TokenType EQ = "==";
-const TokenType NEQ = "!=";
+constexpr TokenType ASSIGN = TokenType::ASSIGN;
+constexpr TokenType PLUS = TokenType::PLUS;
+constexpr TokenType MINUS = TokenType::MINUS;
+constexpr TokenType BANG = TokenType::BANG;
+constexpr TokenType ASTERISK = TokenType::ASTERISK;
+constexpr TokenType SLASH = TokenType::SLASH;
+constexpr TokenType LT = TokenType::LT;
+constexpr TokenType GT = TokenType::GT;
+constexpr TokenType EQ = TokenType::EQ;
+constexpr TokenType NEQ = TokenType::NEQ;
 
 
-const TokenType COMMA = ",";
-const TokenType SEMICOLON = ";";
-const TokenType COLON = ":";
+constexpr TokenType COMMA = TokenType::COMMA;
+constexpr TokenType SEMICOLON = TokenType::SEMICOLON;
+constexpr TokenType COLON = TokenType::COLON;
 
-const TokenType LPAREN = "(";
-const TokenType RPAREN = ")";
-const TokenType LBRACKET = "[";
-const TokenType RBRACKET = "]";
-const TokenType LBRACE = "{";
-const TokenType RBRACE = "}";
+constexpr TokenType LPAREN = TokenType::LPAREN;
+constexpr TokenType RPAREN = TokenType::RPAREN;
+constexpr TokenType LBRACKET = TokenType::LBRACKET;
+constexpr TokenType RBRACKET = TokenType::RBRACKET;
+constexpr TokenType LBRACE = TokenType::LBRACE;
+constexpr TokenType RBRACE = TokenType::RBRACE;
 
 // key word
-const TokenType FUNCTION = "FUNCTION";
-const TokenType LET = "LET";
-const TokenType TRUE = "TRUE";
-const TokenType FALSE = "FALSE";
-const TokenType IF = "IF";
-const TokenType ELSE = "ELSE";
-const TokenType RETURN = "RETURN";
+constexpr TokenType FUNCTION = TokenType::FUNCTION;
+constexpr TokenType LET = TokenType::LET;
+constexpr TokenType TRUE = TokenType::TRUE;
+constexpr TokenType FALSE = TokenType::FALSE;
+constexpr TokenType IF = TokenType::IF;
+constexpr TokenType ELSE = TokenType::ELSE;
+constexpr TokenType RETURN = TokenType::RETURN;
 
-const TokenType STRING = "STRING";
+constexpr TokenType STRING = TokenType::STRING;
+
+// map: TokenType -> name, only for messages
+constexpr std::array<std::string_view, count> names {
+	"ILLEGAL",
+	"EOF",
+
+	"IDENT",
+	"INT",
+
+	"=",
+	"+",
+	"-",
+	"!",
+	"*",
+	"/",
+	"<",
+	">",
+	"==",
+	"!=",
+
+	",",
+	";",
+	":",
+
+	"(",
+	")",
+	"[",
+	"]",
+	"{",
+	"}",
+
+	"FUNCTION",
+	"LET",
+	"TRUE",
+	"FALSE",
+	"IF",
+	"ELSE",
+	"RETURN",
+
+	"STRING",
+};
+
+// string_view of names is null-terminated, so it is also ok for printf
+constexpr std::string_view name(TokenType t) noexcept
+{
+	return names[index(t)];
+}
 
+// map: TokenType -> how it is written in the source,
+// empty for the token types whose literal varies
+constexpr std::array<std::string_view, count> spellings {
+	"",
+	"",
+
+	"",
+	"",
+
+	"=",
+	"+",
+	"-",
+	"!",
+	"*",
+	"/",
+	"<",
+	">",
+	"==",
+	"!=",
+
+	",",
+	";",
+	":",
+
+	"(",
+	")",
+	"[",
+	"]",
+	"{",
+	"}",
+
+	"fn",
+	"let",
+	"true",
+	"false",
+	"if",
+	"else",
+	"return",
+
+	"",
+};
+
+constexpr std::string_view spelling(TokenType t) noexcept
+{
+	return spellings[index(t)];
+}
+
+std::ostream& operator<<(std::ostream& out, TokenType t);
+
+// key words, their code tokens are spellings
+constexpr std::array keywords {FUNCTION, LET, TRUE, FALSE, IF, ELSE, RETURN};
+
+// perfect hash for keywords, the size of keyword_table is a power of 2
+constexpr std::size_t keyword_hash(std::string_view s, std::size_t seed) noexcept
+{
+	return (s.size() + static_cast<unsigned char>(s.front()) * seed
+			+ static_cast<unsigned char>(s.back())) & 15;
+}
+
+// the first seed which maps every keyword to a distinct slot
+consteval std::size_t find_keyword_seed()
+{
+	for (std::size_t seed = 1; ; ++seed) {
+		std::array<bool, 16> used{};
+		bool ok = true;
+		for (auto k: keywords) {
+			auto h = keyword_hash(spelling(k), seed);
+			if (used[h]) {
+				ok = false;
+				break;
+			}
+			used[h] = true;
+		}
+		if (ok) return seed;
+	}
+}
+
+constexpr std::size_t keyword_seed = find_keyword_seed();
+
+// slot -> keyword, IDENT for empty slots
+constexpr std::array<TokenType, 16> keyword_table = [] {
+	std::array<TokenType, 16> table{};
+	table.fill(IDENT);
+	for (auto k: keywords)
+		table[keyword_hash(spelling(k), keyword_seed)] = k;
+	return table;
+}();
+
+// get the ident token_type, one hash and at most one compare
+constexpr TokenType lookup_ident(std::string_view ident) noexcept
+{
+	if (ident.empty()) return IDENT;
+	auto t = keyword_table[keyword_hash(ident, keyword_seed)];
+	// spelling(IDENT) is empty, which never equals ident
+	return spelling(t) == ident ? t : IDENT;
+}
 
-// get the ident token_type
-TokenType lookup_ident(std::string ident);
-	
 }
@@ -0,0 +1,173 @@
+#include "lexer/scan.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MONKEY_SCAN_X86
+#endif
+
+namespace lexer::scan {
+
+namespace {
+
+template<cls K>
+const char* skip_scalar(const char* p, const char* end) noexcept
+{
+	return skip(p, end, K);
+}
+
+constexpr kernels scalar_kernels {
+	"scalar",
+	skip_scalar<space>,
+	skip_scalar<letter>,
+	skip_scalar<digit>,
+	skip_scalar<string_body>,
+};
+
+#ifdef MONKEY_SCAN_X86
+
+// Both widths test a class with compares only:
+// c in [lo, lo + n) <=> (c - lo) ^ 0x80 < n - 128, as signed bytes.
+
+__attribute__((target("sse2")))
+inline __m128i eq16(__m128i v, char c) noexcept
+{
+	return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+__attribute__((target("sse2")))
+inline __m128i in16(__m128i v, char lo, char n) noexcept
+{
+	auto biased = _mm_xor_si128(_mm_sub_epi8(v, _mm_set1_epi8(lo)), _mm_set1_epi8(char(0x80)));
+	return _mm_cmplt_epi8(biased, _mm_set1_epi8(char(n - 128)));
+}
+
+// bit i is set if p[i] ends the run
+template<cls K>
+__attribute__((target("sse2")))
+inline unsigned stops16(const char* p) noexcept
+{
+	auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+
+	__m128i m;
+	if constexpr (K == space)
+		m = _mm_or_si128(_mm_or_si128(eq16(v, ' '), eq16(v, '\n')), _mm_or_si128(eq16(v, '\t'), eq16(v, '\r')));
+	else if constexpr (K == letter)
+		m = _mm_or_si128(in16(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 26), eq16(v, '_'));
+	else if constexpr (K == digit)
+		m = in16(v, '0', 10);
+	else
+		// the stops themselves
+		return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(eq16(v, '"'), eq16(v, 0))));
+
+	return ~static_cast<unsigned>(_mm_movemask_epi8(m)) & 0xFFFF;
+}
+
+template<cls K>
+__attribute__((target("sse2")))
+const char* skip_sse2(const char* p, const char* end) noexcept
+{
+	for (; end - p >= 16; p += 16) {
+		if (auto s = stops16<K>(p); s)
+			return p + __builtin_ctz(s);
+	}
+	return skip(p, end, K);
+}
+
+__attribute__((target("avx2")))
+inline __m256i eq32(__m256i v, char c) noexcept
+{
+	return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+__attribute__((target("avx2")))
+inline __m256i in32(__m256i v, char lo, char n) noexcept
+{
+	auto biased = _mm256_xor_si256(_mm256_sub_epi8(v, _mm256_set1_epi8(lo)), _mm256_set1_epi8(char(0x80)));
+	return _mm256_cmpgt_epi8(_mm256_set1_epi8(char(n - 128)), biased);
+}
+
+template<cls K>
+__attribute__((target("avx2")))
+inline unsigned stops32(const char* p) noexcept
+{
+	auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+
+	__m256i m;
+	if constexpr (K == space)
+		m = _mm256_or_si256(_mm256_or_si256(eq32(v, ' '), eq32(v, '\n')), _mm256_or_si256(eq32(v, '\t'), eq32(v, '\r')));
+	else if constexpr (K == letter)
+		m = _mm256_or_si256(in32(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 26), eq32(v, '_'));
+	else if constexpr (K == digit)
+		m = in32(v, '0', 10);
+	else
+		return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(eq32(v, '"'), eq32(v, 0))));
+
+	return ~static_cast<unsigned>(_mm256_movemask_epi8(m));
+}
+
+template<cls K>
+__attribute__((target("avx2")))
+const char* skip_avx2(const char* p, const char* end) noexcept
+{
+	for (; end - p >= 32; p += 32) {
+		if (auto s = stops32<K>(p); s)
+			return p + __builtin_ctz(s);
+	}
+	// the tail is still worth a 16-byte step
+	return skip_sse2<K>(p, end);
+}
+
+constexpr kernels sse2_kernels {
+	"sse2",
+	skip_sse2<space>,
+	skip_sse2<letter>,
+	skip_sse2<digit>,
+	skip_sse2<string_body>,
+};
+
+constexpr kernels avx2_kernels {
+	"avx2",
+	skip_avx2<space>,
+	skip_avx2<letter>,
+	skip_avx2<digit>,
+	skip_avx2<string_body>,
+};
+
+#endif
+
+} // namespace
+
+kernels const& scalar() noexcept
+{
+	return scalar_kernels;
+}
+
+kernels const* sse2() noexcept
+{
+#ifdef MONKEY_SCAN_X86
+	return __builtin_cpu_supports("sse2") ? &sse2_kernels : nullptr;
+#else
+	return nullptr;
+#endif
+}
+
+kernels const* avx2() noexcept
+{
+#ifdef MONKEY_SCAN_X86
+	return __builtin_cpu_supports("avx2") ? &avx2_kernels : nullptr;
+#else
+	return nullptr;
+#endif
+}
+
+kernels const& active() noexcept
+{
+	static kernels const& k = []() -> kernels const& {
+		if (auto* k = avx2()) return *k;
+		if (auto* k = sse2()) return *k;
+		return scalar();
+	}();
+	return k;
+}
+
+}
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <istream>
+#include <unistd.h>
+#include "lexer/stream_lexer.hpp"
+#include "lexer/scan.hpp"
+
+namespace lexer {
+
+namespace {
+
+// char -> TokenType of the single char tokens, ILLEGAL for the others
+constexpr std::array<token::TokenType, 256> single_chars = [] {
+	std::array<token::TokenType, 256> table{};
+	table.fill(token::ILLEGAL);
+	for (std::size_t t = 0; t < token::count; ++t) {
+		auto s = token::spellings[t];
+		if (s.size() == 1)
+			table[static_cast<unsigned char>(s[0])] = static_cast<token::TokenType>(t);
+	}
+	return table;
+}();
+
+// the literal of a fixed token, which never dangles
+token::Token fixed(token::TokenType t)
+{
+	return token::Token{t, token::spelling(t)};
+}
+
+}
+
+StreamLexer::StreamLexer(std::size_t capacity):
+	eof_(false),
+	// peek() needs two chars
+	buf_(new char[std::max<std::size_t>(capacity, 2)]),
+	capacity_(std::max<std::size_t>(capacity, 2))
+{}
+
+StreamLexer::StreamLexer(std::istream& in, std::size_t capacity):
+	StreamLexer(capacity)
+{
+	in_ = &in;
+}
+
+StreamLexer::StreamLexer(int fd, std::size_t capacity):
+	StreamLexer(capacity)
+{
+	fd_ = fd;
+}
+
+std::size_t StreamLexer::read_some(char* buf, std::size_t n)
+{
+	if (in_) {
+		in_->read(buf, n);
+		return in_->gcount();
+	}
+	for (;;) {
+		auto got = ::read(fd_, buf, n);
+		if (got >= 0) return got;
+		if (errno != EINTR) return 0;
+	}
+}
+
+bool StreamLexer::fill(std::size_t n)
+{
+	while (end_ - pos_ < n) {
+		if (eof_) return false;
+		// literals are copied out, so the consumed chars can be dropped
+		std::memmove(buf_.get(), buf_.get() + pos_, end_ - pos_);
+		end_ -= pos_;
+		pos_ = 0;
+		auto got = read_some(buf_.get() + end_, capacity_ - end_);
+		if (got == 0) eof_ = true;
+		end_ += got;
+	}
+	return true;
+}
+
+std::string& StreamLexer::literal_slot()
+{
+	auto& s = literals_[next_literal_++ % literals_.size()];
+	// keep the capacity, no allocation once the slots are warm
+	s.clear();
+	return s;
+}
+
+void StreamLexer::read_run(std::uint8_t k, std::string* out)
+{
+	auto const& kn = scan::active();
+	auto fn = k == scan::space ? kn.skip_space :
+		k == scan::letter ? kn.skip_letters :
+		k == scan::digit ? kn.skip_digits : kn.skip_string_body;
+
+	// a run may straddle any number of refills
+	while (fill(1)) {
+		const char* first = buf_.get() + pos_;
+		const char* last = buf_.get() + end_;
+		auto* stop = fn(first, last);
+		if (out) out->append(first, stop);
+		pos_ += stop - first;
+		if (stop != last) return;
+	}
+}
+
+token::Token StreamLexer::next_token()
+{
+	read_run(scan::space, nullptr);
+
+	char c = cur();
+	switch (c) {
+		case '=':
+			advance();
+			if (cur() == '=') {
+				advance();
+				return fixed(token::EQ);
+			}
+			return fixed(token::ASSIGN);
+		case '!':
+			advance();
+			if (cur() == '=') {
+				advance();
+				return fixed(token::NEQ);
+			}
+			return fixed(token::BANG);
+		case '"': {
+			// TODO support for escapte char ..
+			advance();
+			auto& s = literal_slot();
+			read_run(scan::string_body, &s);
+			// the closing '"', or the end of input
+			advance();
+			return token::Token{token::STRING, s};
+		}
+		case 0:
+			return token::Token{token::END_OF_FILE, {}};
+		default:
+			break;
+	}
+
+	if (scan::is(c, scan::letter)) {
+		auto& s = literal_slot();
+		read_run(scan::letter, &s);
+		auto type = token::lookup_ident(s);
+		return token::Token{type, s, type == token::IDENT ? symbol::intern(s) : symbol::none};
+	}
+	if (scan::is(c, scan::digit)) {
+		auto& s = literal_slot();
+		read_run(scan::digit, &s);
+		return token::Token{token::INT, s};
+	}
+
+	advance();
+	if (auto t = single_chars[static_cast<unsigned char>(c)]; t != token::ILLEGAL)
+		return fixed(t);
+
+	auto& s = literal_slot();
+	s.push_back(c);
+	return token::Token{token::ILLEGAL, s};
+}
+
+}
@@ -0,0 +1,122 @@
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "lexer/symbol.hpp"
+
+namespace symbol {
+
+namespace {
+
+struct table {
+	std::shared_mutex mutex;
+	// deque never moves its elements, keys of ids view them
+	std::deque<std::string> names{""};
+	std::unordered_map<std::string_view, id> ids;
+};
+
+// never destroyed, symbols may be used by other static destructors
+table& the_table()
+{
+	static auto* t = new table;
+	return *t;
+}
+
+// FNV-1a, names are short
+std::uint32_t hash(std::string_view s) noexcept
+{
+	std::uint32_t h = 2166136261u;
+	for (unsigned char c: s) h = (h ^ c) * 16777619u;
+	return h;
+}
+
+// Per thread open addressing cache in front of the table, so lexing hits
+// the same names without locking. Names view the table, which never frees.
+class cache {
+public:
+	id find(std::string_view name, std::uint32_t h) const noexcept
+	{
+		if (slots_.empty()) return none;
+		for (auto i = h & mask(); ; i = (i + 1) & mask()) {
+			auto const& e = slots_[i];
+			if (e.sym == none) return none;
+			if (e.hash == h && e.name == name) return e.sym;
+		}
+	}
+
+	void insert(std::string_view name, std::uint32_t h, id sym)
+	{
+		// at most half full
+		if ((size_ + 1) * 2 > slots_.size()) grow();
+		auto i = h & mask();
+		while (slots_[i].sym != none) i = (i + 1) & mask();
+		slots_[i] = entry{name, h, sym};
+		++size_;
+	}
+
+private:
+	struct entry {
+		std::string_view name;
+		std::uint32_t hash = 0;
+		id sym = none;
+	};
+
+	std::size_t mask() const noexcept { return slots_.size() - 1; }
+
+	void grow()
+	{
+		auto old = std::move(slots_);
+		slots_.assign(old.empty() ? 256 : old.size() * 2, entry{});
+		size_ = 0;
+		for (auto const& e: old)
+			if (e.sym != none) insert(e.name, e.hash, e.sym);
+	}
+
+	std::vector<entry> slots_;
+	std::size_t size_ = 0;
+};
+
+}
+
+id intern(std::string_view name)
+{
+	thread_local cache local;
+	auto h = hash(name);
+	if (auto s = local.find(name, h); s != none)
+		return s;
+
+	auto& t = the_table();
+	{
+		std::shared_lock lock(t.mutex);
+		if (auto it = t.ids.find(name); it != t.ids.end()) {
+			local.insert(it->first, h, it->second);
+			return it->second;
+		}
+	}
+
+	std::unique_lock lock(t.mutex);
+	// may be interned by another thread between the locks
+	id s;
+	std::string_view stored;
+	if (auto it = t.ids.find(name); it != t.ids.end()) {
+		stored = it->first;
+		s = it->second;
+	} else {
+		s = static_cast<id>(t.names.size());
+		stored = t.names.emplace_back(name);
+		t.ids.emplace(stored, s);
+	}
+	local.insert(stored, h, s);
+	return s;
+}
+
+std::string_view name(id s)
+{
+	auto& t = the_table();
+	std::shared_lock lock(t.mutex);
+	return t.names[s];
+}
+
+}
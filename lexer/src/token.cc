@@ -1,25 +1,11 @@
-#include <unordered_map>
+#include <ostream>
 #include "lexer/token.hpp"
 
 namespace token {
 
-// map: code token -> TokenType
-std::unordered_map<std::string, TokenType> keywords{
-	{"fn", FUNCTION},
-	{"let", LET},
-	{"true", TRUE},
-	{"false", FALSE},
-	{"if", IF},
-	{"else", ELSE},
-	{"return", RETURN}
-};
-
-TokenType lookup_ident(std::string ident)
+std::ostream& operator<<(std::ostream& out, TokenType t)
 {
-	if (keywords.contains(ident)) {
-		return keywords[ident];
-	}
-	return IDENT;
+	return out << name(t);
 }
 
 }
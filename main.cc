@@ -1,12 +1,77 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <unistd.h>
 
 #include "repl/repl.hpp"
+#include "repl/runner.hpp"
 
-int main()
+static int usage()
 {
-	std::printf("Hello %s! This is the Monkey programming language!\n", getlogin());
-	std::printf("Feel free to type in commands\n");
-	repl::start(std::cin, std::cout);
-	return 0;
+	std::cerr << "usage: monkey [--engine=tree|vm|closure|both] [script.mk | script.mkc | --stdin | --stream] [args...]\n"
+		"       monkey --compile script.mk [-o script.mkc]\n"
+		"       monkey --files a.mk b.mk... [-- args...]\n"
+		"  without arguments, start the interactive repl\n"
+		"  --stdin    read the whole program from stdin before running it\n"
+		"  --stream   lex stdin through a fixed buffer, for very large programs\n"
+		"  --compile  parse once into a compiled program, which runs without parsing\n"
+		"  --files    run the files as one program, parsing them in parallel\n"
+		"  --engine   evaluate by walking the tree (default), on the bytecode vm, closure\n"
+		"             compiled, or both of tree and vm, failing if their outputs differ;\n"
+		"             the repl takes all but both\n"
+		"  MONKEY_CACHE=dir  keep the compiled programs of the scripts run in dir\n"
+		"  MONKEY_LAZY=1     parse a function body at its first call, syntax errors there are runtime errors\n";
+	return runner::usage;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc >= 2 && std::strncmp(argv[1], "--engine=", 9) == 0) {
+		if (!runner::use(argv[1] + 9))
+			return usage();
+		// as if the option were not there
+		argv[1] = argv[0];
+		--argc;
+		++argv;
+	}
+
+	if (argc < 2) {
+		if (runner::selected == runner::engine::both)
+			return usage();
+		std::printf("Hello %s! This is the Monkey programming language!\n", getlogin());
+		std::printf("Feel free to type in commands\n");
+		if (runner::selected == runner::engine::vm)
+			repl::start<vm::machine>(std::cin, std::cout);
+		else if (runner::selected == runner::engine::closure)
+			repl::start<evaluator::closure_handler>(std::cin, std::cout);
+		else
+			repl::start(std::cin, std::cout);
+		return 0;
+	}
+
+	if (std::strcmp(argv[1], "--compile") == 0) {
+		if (argc == 3)
+			return runner::compile(argv[2], (std::string(argv[2]) + 'c').c_str(), std::cerr);
+		if (argc == 5 && std::strcmp(argv[3], "-o") == 0)
+			return runner::compile(argv[2], argv[4], std::cerr);
+		return usage();
+	}
+
+	if (std::strcmp(argv[1], "--files") == 0) {
+		auto dashes = std::find_if(argv + 2, argv + argc, [](const char* a) { return std::strcmp(a, "--") == 0; });
+		std::vector<std::string> paths(argv + 2, dashes);
+		if (paths.empty())
+			return usage();
+		std::vector<std::string> args(dashes + (dashes != argv + argc), argv + argc);
+		return runner::run_files(paths, args, std::cerr);
+	}
+
+	std::vector<std::string> args(argv + 2, argv + argc);
+	if (std::strcmp(argv[1], "--stdin") == 0)
+		return runner::run_all(std::cin, args, std::cerr);
+	if (std::strcmp(argv[1], "--stream") == 0)
+		return runner::run_stream(STDIN_FILENO, args, std::cerr);
+	if (argv[1][0] == '-')
+		return usage();
+	return runner::run_file(argv[1], args, std::cerr);
 }
@@ -0,0 +1,99 @@
+#pragma once
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ast {
+
+inline namespace v_0_1 {
+
+// A word a user of the nodes builds once and keeps on a node, such as the
+// value the evaluator makes of a literal. A node is not destroyed, so its
+// arena calls release on the word when it is freed. Unset while release
+// is null.
+struct Constant {
+	mutable std::uintptr_t word = 0;
+	mutable void (*release)(std::uintptr_t) = nullptr;
+};
+
+// Memory of the nodes of one parse.
+//
+// Nodes and what they own, vectors and strings, are bump allocated from
+// the arena and never destroyed one by one: freeing the arena frees a few
+// chunks. So a node must not own anything outside the arena.
+//
+// The arena is always held by shared_ptr, the function values of the
+// evaluator keep it alive through aliasing pointers to the nodes.
+class Arena: public std::enable_shared_from_this<Arena> {
+public:
+	static std::shared_ptr<Arena> make()
+	{
+		return std::shared_ptr<Arena>(new Arena);
+	}
+
+	Arena(Arena const&) = delete;
+	Arena& operator=(Arena const&) = delete;
+
+	~Arena()
+	{
+		for (auto* c: constants_)
+			if (c->release) c->release(c->word);
+	}
+
+	template<class T, class... Args>
+	T* make(Args&&... args)
+	{
+		auto* node = ::new (pool_.allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		if constexpr (requires { { node->constant_ } -> std::same_as<Constant&>; })
+			constants_.push_back(&node->constant_);
+		return node;
+	}
+
+	// a copy of s living as long as the arena
+	std::string_view copy(std::string_view s)
+	{
+		if (s.empty()) return {};
+		auto* p = static_cast<char*>(pool_.allocate(s.size(), 1));
+		std::memcpy(p, s.data(), s.size());
+		return {p, s.size()};
+	}
+
+	std::pmr::memory_resource* resource() noexcept { return &pool_; }
+
+	// the node owned by the arena, shared with those outliving the program
+	template<class T>
+	std::shared_ptr<T> share(T* node)
+	{
+		return std::shared_ptr<T>(shared_from_this(), node);
+	}
+
+	// the nodes of this arena refer to the nodes of other, such as a merge
+	void keep(std::shared_ptr<Arena> other)
+	{
+		kept_.push_back(std::move(other));
+	}
+
+private:
+	Arena() = default;
+
+	std::pmr::monotonic_buffer_resource pool_{4096};
+	std::vector<std::shared_ptr<Arena>> kept_;
+	// of the nodes made here
+	std::vector<const Constant*> constants_;
+};
+
+// no-op deleter, the memory of a node is released with its arena
+struct in_arena {
+	template<class T>
+	void operator()(T*) const noexcept {}
+};
+
+}
+
+}
@@ -1,31 +1,137 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include <memory_resource>
 #include <sstream>
 
 #include "lexer/token.hpp"
+#include "lexer/symbol.hpp"
+#include "arena.hpp"
 
 namespace ast {
 
 // using extend
 inline namespace v_0_1 {
 
+// the concrete nodes, the tag by which a node is dispatched on without
+// RTTI. The order is also that of flat::Kind, part of the compiled format.
+enum class Kind: std::uint8_t {
+	let,
+	ret,
+	expr_stmt,
+	block,
+	ident,
+	integer,
+	boolean,
+	string,
+	prefix,
+	infix,
+	if_expr,
+	function,
+	call,
+	array,
+	index,
+	hash,
+};
+inline constexpr std::size_t kinds = static_cast<std::size_t>(Kind::hash) + 1;
+
+constexpr std::size_t index(Kind k) noexcept
+{
+	return static_cast<std::size_t>(k);
+}
+
+// the operators of prefix and infix expressions, resolved from the token
+// by the parser so that the evaluator never compares spellings
+enum class Op: std::uint8_t {
+	plus,
+	minus,
+	bang,
+	asterisk,
+	slash,
+	lt,
+	gt,
+	eq,
+	neq,
+	unknown,
+};
+inline constexpr std::size_t ops = static_cast<std::size_t>(Op::unknown) + 1;
+
+constexpr std::size_t index(Op op) noexcept
+{
+	return static_cast<std::size_t>(op);
+}
+
+constexpr Op to_op(token::TokenType t) noexcept
+{
+	switch (t) {
+		case token::PLUS: return Op::plus;
+		case token::MINUS: return Op::minus;
+		case token::BANG: return Op::bang;
+		case token::ASTERISK: return Op::asterisk;
+		case token::SLASH: return Op::slash;
+		case token::LT: return Op::lt;
+		case token::GT: return Op::gt;
+		case token::EQ: return Op::eq;
+		case token::NEQ: return Op::neq;
+		default: return Op::unknown;
+	}
+}
+
+constexpr std::string_view spelling(Op op) noexcept
+{
+	constexpr std::string_view spellings[ops] {"+", "-", "!", "*", "/", "<", ">", "==", "!=", ""};
+	return spellings[index(op)];
+}
+
 struct Node {
+	// set by the concrete node, see Tagged
+	const Kind kind_;
+
 	virtual std::string token_literal() const noexcept = 0;
 	virtual std::string to_string() const noexcept = 0;
 	virtual ~Node() = default;
+
+protected:
+	explicit Node(Kind k) noexcept: kind_(k) {}
 };
 
-struct Statement: Node {};
-using StmtPtr = std::unique_ptr<Statement>;
+// nodes live in the Arena of their program, see arena.hpp
+template<class T>
+using NodePtr = std::unique_ptr<T, in_arena>;
 
-struct Expression: Node {};
-using ExpressionPtr = std::unique_ptr<Expression>;
+struct Statement: Node {
+protected:
+	using Node::Node;
+};
+using StmtPtr = NodePtr<Statement>;
+using Statements = std::pmr::vector<StmtPtr>;
+
+struct Expression: Node {
+protected:
+	using Node::Node;
+};
+
+// base of the node of kind K
+template<Kind K, class Base>
+struct Tagged: Base {
+	static constexpr Kind kind = K;
+
+	Tagged() noexcept: Base(K) {}
+};
+using ExpressionPtr = NodePtr<Expression>;
 
 struct Program {
-	std::vector<StmtPtr> statements;
+	// declared first, the nodes go away with it
+	std::shared_ptr<Arena> arena_;
+	Statements statements;
 	// std::vector<std::string> errors;
+
+	Program(std::shared_ptr<Arena> arena, Statements&& stmts):
+		arena_(std::move(arena)), statements(std::move(stmts)) {}
+
 	std::string to_string() const noexcept
 	{
 		
@@ -37,30 +143,62 @@ struct Program {
 	}
 };
 
+// where the value of an identifier is, set by the resolver of the evaluator
+struct Address {
+	enum Scope: std::uint8_t {
+		unresolved,
+		// slot of the frame of the function depth functions up
+		local,
+		// slot is the symbol
+		global,
+		// slot is the index of the builtin
+		builtin,
+	};
+	Scope scope = unresolved;
+	std::uint16_t depth = 0;
+	std::uint32_t slot = 0;
+	// of a local slot whose let may not have run by the read, such as a let
+	// in a branch: where the name is read while the slot is unset
+	const Address* unset = nullptr;
+};
+
+// the names of a function, by slot, and of the functions around it
+struct Scope {
+	std::pmr::vector<symbol::id> names;
+	const Scope* upper = nullptr;
+};
+
 // In some areas, Identifier does not generate values.
 // But to stay easy, we use a same struct.
-struct Identifier: Expression {
-	token::Token token_;
-	std::string value_;
+struct Identifier: Tagged<Kind::ident, Expression> {
+	token::TokenType token_;
+	// interned name
+	symbol::id symbol_;
+	mutable Address addr_;
 
 	Identifier() = default;
-	Identifier(token::Token t, std::string v):
-		token_(t), value_(v) {}
+	Identifier(token::TokenType t, symbol::id s):
+		token_(t), symbol_(s) {}
+
+	std::string_view name() const noexcept
+	{
+		return symbol::name(symbol_);
+	}
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{name()};
 	}
 
 	std::string to_string() const noexcept override
 	{
-		return value_;
+		return std::string{name()};
 	}
 };
-using IdentifierPtr = std::unique_ptr<Identifier>;
+using IdentifierPtr = NodePtr<Identifier>;
 
-struct LetStmt : Statement {
-	token::Token token_; // let token
+struct LetStmt: Tagged<Kind::let, Statement> {
+	token::TokenType token_; // let token
 	IdentifierPtr name_;
 	// the value which generated by expression
 	ExpressionPtr value_;
@@ -73,13 +211,13 @@ struct LetStmt : Statement {
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{token::spelling(token_)};
 	}
 	
 	std::string to_string() const noexcept override
 	{
 		std::ostringstream out;
-		out << token_.literal << ' ' << name_->to_string() << " = ";
+		out << token::spelling(token_) << ' ' << name_->to_string() << " = ";
 		if (value_)
 			out << value_->to_string();
 		out << ';';
@@ -87,19 +225,19 @@ struct LetStmt : Statement {
 	}
 };
 
-struct ReturnStmt: Statement {
-	token::Token token_; // return token
+struct ReturnStmt: Tagged<Kind::ret, Statement> {
+	token::TokenType token_; // return token
 	ExpressionPtr return_value_;
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{token::spelling(token_)};
 	}
 
 	std::string to_string() const noexcept override
 	{
 		std::ostringstream out;
-		out << token_.literal << ' ';
+		out << token::spelling(token_) << ' ';
 		if (return_value_)
 			out << return_value_->to_string();
 		out << ';';
@@ -107,13 +245,13 @@ struct ReturnStmt: Statement {
 	}
 };
 
-struct ExpressionStmt: Statement {
-	token::Token token_;
+struct ExpressionStmt: Tagged<Kind::expr_stmt, Statement> {
+	token::TokenType token_;
 	ExpressionPtr expression_;
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return expression_ ? expression_->token_literal() : "";
 	}
 
 	std::string to_string() const noexcept override
@@ -123,37 +261,41 @@ struct ExpressionStmt: Statement {
 	
 };
 
-struct IntegerLiteral: Expression {
-	token::Token token_;
+struct IntegerLiteral: Tagged<Kind::integer, Expression> {
+	token::TokenType token_;
 	std::int64_t value_;
+	// its value, built once by the evaluator
+	Constant constant_;
 
 	IntegerLiteral() = default;
-	IntegerLiteral(token::Token t, std::int64_t v):
+	IntegerLiteral(token::TokenType t, std::int64_t v):
 		token_(t), value_(v) {}
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::to_string(value_);
 	}
 
 	std::string to_string() const noexcept override
 	{
-		return token_.literal;
+		return std::to_string(value_);
 	}
 };
 
-struct PrefixExpression: Expression {
-	token::Token token_;
-	std::string operator_;
+struct PrefixExpression: Tagged<Kind::prefix, Expression> {
+	token::TokenType token_;
+	// spelling of the operator, never dangles
+	std::string_view operator_;
+	Op op_ = Op::unknown;
 	ExpressionPtr right_;
 
 	PrefixExpression() = default;
-	PrefixExpression(token::Token t, std::string op):
-		token_(t), operator_(op) {}
+	PrefixExpression(token::TokenType t, std::string_view op):
+		token_(t), operator_(op), op_(to_op(t)) {}
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{token::spelling(token_)};
 	}
 
 	std::string to_string() const noexcept override
@@ -164,18 +306,20 @@ struct PrefixExpression: Expression {
 	}
 };
 
-struct InfixExpression: Expression {
-	token::Token token_;
+struct InfixExpression: Tagged<Kind::infix, Expression> {
+	token::TokenType token_;
 	ExpressionPtr left_;
-	std::string operator_;
+	// spelling of the operator, never dangles
+	std::string_view operator_;
+	Op op_ = Op::unknown;
 	ExpressionPtr right_;
 
 	InfixExpression() = default;
-	InfixExpression(token::Token t, std::string op, Expression* left):
-		token_(t), operator_(op), left_(left) {}
+	InfixExpression(token::TokenType t, std::string_view op, Expression* left):
+		token_(t), left_(left), operator_(op), op_(to_op(t)) {}
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{token::spelling(token_)};
 	}
 
 	std::string to_string() const noexcept override
@@ -187,31 +331,35 @@ struct InfixExpression: Expression {
 	}
 };
 
-struct Boolean: Expression {
-	token::Token token_;
+struct Boolean: Tagged<Kind::boolean, Expression> {
+	token::TokenType token_;
 	bool value_;
 
 	Boolean() = default;
-	Boolean(token::Token t, bool v): token_(t), value_(v) {}
+	Boolean(token::TokenType t, bool v): token_(t), value_(v) {}
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{token::spelling(token_)};
 	}
 
 	std::string to_string() const noexcept override
 	{
-		return token_.literal;
+		return std::string{token::spelling(token_)};
 	}
 };
 
-struct BlockStmt: Statement {
-	token::Token token_;
-	std::vector<StmtPtr> statements_;
+struct BlockStmt: Tagged<Kind::block, Statement> {
+	token::TokenType token_;
+	Statements statements_;
+
+	BlockStmt() = default;
+	BlockStmt(token::TokenType t, Statements&& stmts):
+		token_(t), statements_(std::move(stmts)) {}
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{token::spelling(token_)};
 	}
 	
 	std::string to_string() const noexcept override
@@ -225,17 +373,17 @@ struct BlockStmt: Statement {
 	}
 };
 
-using BlockStmtPtr = std::unique_ptr<BlockStmt>;
+using BlockStmtPtr = NodePtr<BlockStmt>;
 
-struct IfExpression: Expression {
-	token::Token token_;
+struct IfExpression: Tagged<Kind::if_expr, Expression> {
+	token::TokenType token_;
 	ExpressionPtr cond_;
 	BlockStmtPtr consequence_;
 	BlockStmtPtr alternative_;
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{token::spelling(token_)};
 	}
 
 	std::string to_string() const noexcept override
@@ -249,26 +397,86 @@ struct IfExpression: Expression {
 	}
 };
 
-struct FunctionLiteral: Expression {
+struct FunctionLiteral: Tagged<Kind::function, Expression> {
 	using ParamType = Identifier;
-	using Parameters = std::shared_ptr<std::vector<IdentifierPtr>>;
+	using ParamList = std::pmr::vector<IdentifierPtr>;
+	// a function value may outlive its program, these keep the arena alive
+	using Parameters = std::shared_ptr<const ParamList>;
 	using Body = std::shared_ptr<BlockStmt>;
-	token::Token token_;
-	Parameters parameters_;
-	Body body_;
+	// parses the source of a lazy body into a block kept alive by the arena,
+	// null and the first error for a syntax error
+	using BodyParser = BlockStmt* (*)(std::string_view source, Arena& arena, std::string& error);
+	token::TokenType token_;
+	ParamList parameters_;
+	// null for a lazy body, until the first body()
+	mutable BlockStmt* body_ = nullptr;
+	// arena of the node, to share it
+	Arena* arena_ = nullptr;
+	// a lazy body: its source after the '{' up to its '}', in the arena,
+	// and the parser of it, reset once parsed
+	std::string_view source_;
+	mutable BodyParser parse_body_ = nullptr;
+	mutable std::string_view error_;
+	// to_string(), once rendered
+	mutable std::string_view text_;
+	// set by the resolver: the size of a frame of a call, and for a body
+	// it has not resolved yet, the scopes around it in the arena
+	mutable std::uint32_t frame_size_ = 0;
+	mutable const Scope* scope_ = nullptr;
+	mutable bool resolved_ = false;
 
 	FunctionLiteral() = default;
-	FunctionLiteral(token::Token t, Parameters::element_type&& ps, BlockStmt* body):
-		token_(t),
-		parameters_(std::make_shared<typename Parameters::element_type>(std::move(ps))),
-		body_(body) {}
-	// FunctionLiteral(FunctionLiteral&& f):
-	//   token_(f.token_), parameters_(std::move(f.parameters_)), body_(std::move(f.body_))
-	// {}
+	FunctionLiteral(token::TokenType t, ParamList&& ps, BlockStmt* body, Arena* arena):
+		token_(t), parameters_(std::move(ps)), body_(body), arena_(arena) {}
+	FunctionLiteral(token::TokenType t, ParamList&& ps, std::string_view source, BodyParser parse, Arena* arena):
+		token_(t), parameters_(std::move(ps)), arena_(arena), source_(source), parse_body_(parse) {}
+
+	// the literal, shared with the function values made of it
+	std::shared_ptr<const FunctionLiteral> share() const
+	{
+		return arena_->share(this);
+	}
+
+	Parameters parameters() const
+	{
+		return arena_->share(&parameters_);
+	}
+
+	// a lazy body is parsed by the first call, every closure of the literal
+	// shares it. Null if it has a syntax error, see error().
+	Body body() const
+	{
+		auto* b = block();
+		return b ? arena_->share(b) : nullptr;
+	}
+
+	// body(), for those holding the literal
+	BlockStmt* block() const
+	{
+		if (parse_body_) {
+			std::string error;
+			body_ = parse_body_(source_, *arena_, error);
+			error_ = arena_->copy(error);
+			parse_body_ = nullptr;
+		}
+		return body_;
+	}
+
+	// to_string() rendered once, as long as the arena: function values
+	// print their literal
+	std::string_view text() const
+	{
+		if (text_.empty()) text_ = arena_->copy(to_string());
+		return text_;
+	}
+
+	bool parsed() const noexcept { return !parse_body_; }
+
+	std::string_view error() const noexcept { return error_; }
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{token::spelling(token_)};
 	}
 
 
@@ -276,40 +484,41 @@ struct FunctionLiteral: Expression {
 	std::string to_string() const noexcept override
 	{
 		std::ostringstream out;
-		out << token_.literal << '(';
+		out << token::spelling(token_) << '(';
 		// join: BUG: size_t is unsigned
-		if (parameters_ && !parameters_->empty()) {
-			std::size_t n = parameters_->size() - 1;
+		if (!parameters_.empty()) {
+			std::size_t n = parameters_.size() - 1;
 			for (std::size_t i = 0; i < n; ++i) {
-				out << (*parameters_)[i]->to_string() << ", ";
+				out << parameters_[i]->to_string() << ", ";
 			}
-			out << (*parameters_)[n]->to_string();
+			out << parameters_[n]->to_string();
 		}
 
 		out << ") {";
 
-		if (body_)
-			out	<< body_->to_string();
-
-		out << " }";
+		// a lazy body with a syntax error, as it is written
+		if (auto* body = block())
+			out	<< body->to_string() << " }";
+		else
+			out << source_;
 		return out.str();
 	}
 };
 
-struct CallExpression: Expression {
-	token::Token token_;
+struct CallExpression: Tagged<Kind::call, Expression> {
+	token::TokenType token_;
 	ExpressionPtr fn_;
 	using ArgType = Expression;
-	using Arguments = std::vector<ExpressionPtr>;
+	using Arguments = std::pmr::vector<ExpressionPtr>;
 	Arguments args_;
 
 	CallExpression() = default;
-	CallExpression(token::Token t, Expression* fn, Arguments&& args):
+	CallExpression(token::TokenType t, Expression* fn, Arguments&& args):
 		token_(t), fn_(fn), args_(std::move(args)) {}
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{token::spelling(token_)};
 	}
 
 	std::string to_string() const noexcept override
@@ -325,40 +534,45 @@ struct CallExpression: Expression {
 };
 
 
-struct StringLiteral: Expression {
-	token::Token token_;
-	std::string value_;
+struct StringLiteral: Tagged<Kind::string, Expression> {
+	token::TokenType token_;
+	// copied into the arena
+	std::string_view value_;
+	// its value, built once by the evaluator
+	Constant constant_;
 
 	StringLiteral() = default;
-	StringLiteral(token::Token t, std::string const& v):
+	StringLiteral(token::TokenType t, std::string_view v):
 		token_(t), value_(v) {}
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{value_};
 	}
 
 	std::string to_string() const noexcept override
 	{
-		return value_;
+		return std::string{value_};
 	}
 };
 
-struct ArrayLiteral: Expression {
-	token::Token token_;
+struct ArrayLiteral: Tagged<Kind::array, Expression> {
+	token::TokenType token_;
 	using ElementType = Expression;
 	// ??? Using shared_ptr for reference type?
 	// Moreover, now ASSIGN is unsupported, so reference is meaningless.
-	using Elements = std::vector<std::unique_ptr<ElementType>>;
+	using Elements = std::pmr::vector<NodePtr<ElementType>>;
 	Elements elements_;
+	// its elements, built once by the evaluator when they are all literals
+	Constant constant_;
 
 	ArrayLiteral() = default;
-	ArrayLiteral(token::Token t, Elements&& elems):
+	ArrayLiteral(token::TokenType t, Elements&& elems):
 		token_(t), elements_(std::move(elems)) {}
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{token::spelling(token_)};
 	}
 
 	std::string to_string() const noexcept override
@@ -376,18 +590,18 @@ struct ArrayLiteral: Expression {
 	}
 };
 
-struct IndexExpression: Expression {
-	token::Token token_;
+struct IndexExpression: Tagged<Kind::index, Expression> {
+	token::TokenType token_;
 	ExpressionPtr left_;
 	ExpressionPtr index_;
 
 	IndexExpression() = default;
-	IndexExpression(token::Token t, Expression* l, Expression* i):
+	IndexExpression(token::TokenType t, Expression* l, Expression* i):
 		token_(t), left_(l), index_(i) {}
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{token::spelling(token_)};
 	}
 
 	std::string to_string() const noexcept override
@@ -398,18 +612,21 @@ struct IndexExpression: Expression {
 	}
 };
 
-struct HashTableLiteral: Expression {
-	token::Token token_; // {
+struct HashTableLiteral: Tagged<Kind::hash, Expression> {
+	token::TokenType token_; // {
 	using Pair = std::pair<ExpressionPtr, ExpressionPtr>;
-	std::vector<Pair> pairs_;
+	using Pairs = std::pmr::vector<Pair>;
+	Pairs pairs_;
+	// its value, built once by the evaluator when its pairs are all literals
+	Constant constant_;
 
 	HashTableLiteral() = default;
-	HashTableLiteral(token::Token t, std::vector<Pair>&& ps):
+	HashTableLiteral(token::TokenType t, Pairs&& ps):
 		token_(t), pairs_(std::move(ps)) {}
 
 	std::string token_literal() const noexcept override
 	{
-		return token_.literal;
+		return std::string{token::spelling(token_)};
 	}
 	std::string to_string() const noexcept override
 	{
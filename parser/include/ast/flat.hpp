@@ -0,0 +1,421 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+
+namespace ast {
+
+inline namespace v_0_1 {
+
+// Flat encoding of a program.
+//
+// A node is an index into parallel arrays: its kind, its token and two
+// 32-bit operands. Lists of children are ranges of `children`, integers
+// and text are in side tables. No pointer anywhere, so the arrays can be
+// written out and mapped back as they are.
+//
+//   kind       a                     b
+//   let        name                  value
+//   ret        value
+//   expr_stmt  expression
+//   block      children: statements...
+//   ident      name
+//   integer    integers[a]
+//   boolean    0 or 1
+//   string     offset in chars       size
+//   prefix     right
+//   infix      left                  right
+//   if_expr    children: cond, consequence, alternative
+//   function   children: parameters..., body
+//   call       children: fn, arguments...
+//   array      children: elements...
+//   index      left                  index
+//   hash       children: key, value, key, value...
+//
+// For the children kinds a is the first child and b the count. A missing
+// operand, such as the value of `return;`, is `none`.
+namespace flat {
+
+using node = std::uint32_t;
+inline constexpr node none = UINT32_MAX;
+
+// the order is part of the compiled format
+using Kind = ast::Kind;
+
+// a range of chars
+struct Text {
+	std::uint32_t offset;
+	std::uint32_t size;
+};
+
+// the arrays of a flat program, owned by a Program or mapped from a file
+struct View {
+	std::span<const Kind> kinds;
+	std::span<const token::TokenType> tokens;
+	std::span<const std::uint32_t> a;
+	std::span<const std::uint32_t> b;
+	std::span<const node> children;
+	std::span<const std::int64_t> integers;
+	// names of the identifiers
+	std::span<const Text> names;
+	std::span<const char> chars;
+	// the block of the top level statements
+	node root = none;
+
+	std::size_t size() const noexcept { return kinds.size(); }
+
+	std::string_view text(Text t) const noexcept
+	{
+		return {chars.data() + t.offset, t.size};
+	}
+
+	// ident, or let
+	std::string_view name(node n) const noexcept { return text(names[a[n]]); }
+	std::string_view string(node n) const noexcept { return text({a[n], b[n]}); }
+	std::int64_t integer(node n) const noexcept { return integers[a[n]]; }
+	std::span<const node> list(node n) const noexcept { return children.subspan(a[n], b[n]); }
+};
+
+struct Program {
+	std::vector<Kind> kinds;
+	std::vector<token::TokenType> tokens;
+	std::vector<std::uint32_t> a;
+	std::vector<std::uint32_t> b;
+	std::vector<node> children;
+	std::vector<std::int64_t> integers;
+	std::vector<Text> names;
+	std::vector<char> chars;
+	node root = none;
+
+	std::size_t size() const noexcept { return kinds.size(); }
+
+	View view() const noexcept
+	{
+		return {kinds, tokens, a, b, children, integers, names, chars, root};
+	}
+
+	node add(Kind k, token::TokenType t, std::uint32_t x = none, std::uint32_t y = none)
+	{
+		kinds.push_back(k);
+		tokens.push_back(t);
+		a.push_back(x);
+		b.push_back(y);
+		return static_cast<node>(kinds.size() - 1);
+	}
+
+	node add_list(Kind k, token::TokenType t, std::span<const node> list)
+	{
+		auto first = static_cast<std::uint32_t>(children.size());
+		children.insert(children.end(), list.begin(), list.end());
+		return add(k, t, first, static_cast<std::uint32_t>(list.size()));
+	}
+
+	Text add_text(std::string_view s)
+	{
+		Text t{static_cast<std::uint32_t>(chars.size()), static_cast<std::uint32_t>(s.size())};
+		chars.insert(chars.end(), s.begin(), s.end());
+		return t;
+	}
+};
+
+namespace detail {
+
+class flattener {
+public:
+	explicit flattener(Program& out): out_(out) {}
+
+	node stmts(token::TokenType t, Statements const& ss)
+	{
+		auto base = stack_.size();
+		for (auto const& s: ss) stack_.push_back(stmt(s.get()));
+		return pop_list(Kind::block, t, base);
+	}
+
+	node stmt(const Statement* s)
+	{
+		if (!s) return none;
+		switch (s->kind_) {
+			case Kind::let: {
+				auto* l = static_cast<const LetStmt*>(s);
+				return out_.add(Kind::let, l->token_, name(l->name_->symbol_), expr(l->value_.get()));
+			}
+			case Kind::ret: {
+				auto* r = static_cast<const ReturnStmt*>(s);
+				return out_.add(Kind::ret, r->token_, expr(r->return_value_.get()));
+			}
+			case Kind::expr_stmt: {
+				auto* e = static_cast<const ExpressionStmt*>(s);
+				return out_.add(Kind::expr_stmt, e->token_, expr(e->expression_.get()));
+			}
+			case Kind::block: {
+				auto* b = static_cast<const BlockStmt*>(s);
+				return stmts(b->token_, b->statements_);
+			}
+			default:
+				return none;
+		}
+	}
+
+	node expr(const Expression* e)
+	{
+		if (!e) return none;
+		switch (e->kind_) {
+			case Kind::ident: {
+				auto* i = static_cast<const Identifier*>(e);
+				return out_.add(Kind::ident, i->token_, name(i->symbol_));
+			}
+			case Kind::integer: {
+				auto* i = static_cast<const IntegerLiteral*>(e);
+				out_.integers.push_back(i->value_);
+				return out_.add(Kind::integer, i->token_, out_.integers.size() - 1);
+			}
+			case Kind::boolean: {
+				auto* b = static_cast<const Boolean*>(e);
+				return out_.add(Kind::boolean, b->token_, b->value_);
+			}
+			case Kind::string: {
+				auto* s = static_cast<const StringLiteral*>(e);
+				auto t = out_.add_text(s->value_);
+				return out_.add(Kind::string, s->token_, t.offset, t.size);
+			}
+			case Kind::prefix: {
+				auto* p = static_cast<const PrefixExpression*>(e);
+				return out_.add(Kind::prefix, p->token_, expr(p->right_.get()));
+			}
+			case Kind::infix: {
+				auto* i = static_cast<const InfixExpression*>(e);
+				auto l = expr(i->left_.get());
+				return out_.add(Kind::infix, i->token_, l, expr(i->right_.get()));
+			}
+			case Kind::if_expr: {
+				auto* i = static_cast<const IfExpression*>(e);
+				auto base = stack_.size();
+				stack_.push_back(expr(i->cond_.get()));
+				stack_.push_back(stmt(i->consequence_.get()));
+				stack_.push_back(stmt(i->alternative_.get()));
+				return pop_list(Kind::if_expr, i->token_, base);
+			}
+			case Kind::function: {
+				auto* f = static_cast<const FunctionLiteral*>(e);
+				auto base = stack_.size();
+				for (auto const& p: f->parameters_) stack_.push_back(expr(p.get()));
+				stack_.push_back(stmt(f->block()));
+				return pop_list(Kind::function, f->token_, base);
+			}
+			case Kind::call: {
+				auto* c = static_cast<const CallExpression*>(e);
+				auto base = stack_.size();
+				stack_.push_back(expr(c->fn_.get()));
+				for (auto const& arg: c->args_) stack_.push_back(expr(arg.get()));
+				return pop_list(Kind::call, c->token_, base);
+			}
+			case Kind::array: {
+				auto* a = static_cast<const ArrayLiteral*>(e);
+				auto base = stack_.size();
+				for (auto const& elem: a->elements_) stack_.push_back(expr(elem.get()));
+				return pop_list(Kind::array, a->token_, base);
+			}
+			case Kind::index: {
+				auto* i = static_cast<const IndexExpression*>(e);
+				auto l = expr(i->left_.get());
+				return out_.add(Kind::index, i->token_, l, expr(i->index_.get()));
+			}
+			case Kind::hash: {
+				auto* h = static_cast<const HashTableLiteral*>(e);
+				auto base = stack_.size();
+				for (auto const& [k, v]: h->pairs_) {
+					stack_.push_back(expr(k.get()));
+					stack_.push_back(expr(v.get()));
+				}
+				return pop_list(Kind::hash, h->token_, base);
+			}
+			default:
+				return none;
+		}
+	}
+
+private:
+	// the children pushed since base, they are contiguous only once complete
+	node pop_list(Kind k, token::TokenType t, std::size_t base)
+	{
+		auto n = out_.add_list(k, t, std::span<const node>(stack_).subspan(base));
+		stack_.resize(base);
+		return n;
+	}
+
+	// every distinct name is stored once
+	std::uint32_t name(symbol::id s)
+	{
+		auto [it, fresh] = names_.try_emplace(s, out_.names.size());
+		if (fresh) out_.names.push_back(out_.add_text(symbol::name(s)));
+		return it->second;
+	}
+
+	Program& out_;
+	std::unordered_map<symbol::id, std::uint32_t> names_;
+	// children of the lists being flattened
+	std::vector<node> stack_;
+};
+
+class unflattener {
+public:
+	explicit unflattener(View v): v_(v), arena_(Arena::make()), symbols_(v.names.size(), symbol::none) {}
+
+	std::unique_ptr<ast::Program> program()
+	{
+		Statements stmts(arena_->resource());
+		if (auto* b = block(v_.root)) stmts = std::move(b->statements_);
+		return std::make_unique<ast::Program>(std::move(arena_), std::move(stmts));
+	}
+
+private:
+	template<class T>
+	NodePtr<T> ptr(T* p) { return NodePtr<T>{p}; }
+
+	BlockStmt* block(node n)
+	{
+		if (n == none) return nullptr;
+		Statements ss(arena_->resource());
+		ss.reserve(v_.b[n]);
+		for (auto s: v_.list(n)) {
+			if (auto* p = stmt(s)) ss.emplace_back(p);
+		}
+		return arena_->make<BlockStmt>(v_.tokens[n], std::move(ss));
+	}
+
+	Statement* stmt(node n)
+	{
+		if (n == none) return nullptr;
+		auto t = v_.tokens[n];
+		switch (v_.kinds[n]) {
+			case Kind::let: {
+				auto* l = arena_->make<LetStmt>();
+				l->token_ = t;
+				l->name_ = ptr(arena_->make<Identifier>(token::IDENT, sym(v_.a[n])));
+				l->value_ = ptr(expr(v_.b[n]));
+				return l;
+			}
+			case Kind::ret: {
+				auto* r = arena_->make<ReturnStmt>();
+				r->token_ = t;
+				r->return_value_ = ptr(expr(v_.a[n]));
+				return r;
+			}
+			case Kind::expr_stmt: {
+				auto* e = arena_->make<ExpressionStmt>();
+				e->token_ = t;
+				e->expression_ = ptr(expr(v_.a[n]));
+				return e;
+			}
+			case Kind::block:
+				return block(n);
+			default:
+				return nullptr;
+		}
+	}
+
+	Expression* expr(node n)
+	{
+		if (n == none) return nullptr;
+		auto t = v_.tokens[n];
+		switch (v_.kinds[n]) {
+			case Kind::ident:
+				return arena_->make<Identifier>(t, sym(v_.a[n]));
+			case Kind::integer:
+				return arena_->make<IntegerLiteral>(t, v_.integer(n));
+			case Kind::boolean:
+				return arena_->make<Boolean>(t, v_.a[n] != 0);
+			case Kind::string:
+				return arena_->make<StringLiteral>(t, arena_->copy(v_.string(n)));
+			case Kind::prefix: {
+				auto* p = arena_->make<PrefixExpression>(t, token::spelling(t));
+				p->right_ = ptr(expr(v_.a[n]));
+				return p;
+			}
+			case Kind::infix: {
+				auto* i = arena_->make<InfixExpression>(t, token::spelling(t), expr(v_.a[n]));
+				i->right_ = ptr(expr(v_.b[n]));
+				return i;
+			}
+			case Kind::if_expr: {
+				auto list = v_.list(n);
+				auto* i = arena_->make<IfExpression>();
+				i->token_ = t;
+				i->cond_ = ptr(expr(list[0]));
+				i->consequence_ = ptr(block(list[1]));
+				i->alternative_ = ptr(block(list[2]));
+				return i;
+			}
+			case Kind::function: {
+				auto list = v_.list(n);
+				FunctionLiteral::ParamList ps(arena_->resource());
+				ps.reserve(list.size() - 1);
+				for (auto p: list.first(list.size() - 1))
+					ps.emplace_back(arena_->make<Identifier>(v_.tokens[p], sym(v_.a[p])));
+				return arena_->make<FunctionLiteral>(t, std::move(ps), block(list.back()), arena_.get());
+			}
+			case Kind::call: {
+				auto list = v_.list(n);
+				CallExpression::Arguments args(arena_->resource());
+				args.reserve(list.size() - 1);
+				for (auto arg: list.subspan(1)) args.emplace_back(expr(arg));
+				return arena_->make<CallExpression>(t, expr(list[0]), std::move(args));
+			}
+			case Kind::array: {
+				ArrayLiteral::Elements elems(arena_->resource());
+				elems.reserve(v_.b[n]);
+				for (auto e: v_.list(n)) elems.emplace_back(expr(e));
+				return arena_->make<ArrayLiteral>(t, std::move(elems));
+			}
+			case Kind::index:
+				return arena_->make<IndexExpression>(t, expr(v_.a[n]), expr(v_.b[n]));
+			case Kind::hash: {
+				auto list = v_.list(n);
+				HashTableLiteral::Pairs pairs(arena_->resource());
+				pairs.reserve(list.size() / 2);
+				for (std::size_t i = 0; i + 1 < list.size(); i += 2)
+					pairs.emplace_back(ptr(expr(list[i])), ptr(expr(list[i + 1])));
+				return arena_->make<HashTableLiteral>(t, std::move(pairs));
+			}
+			default:
+				return nullptr;
+		}
+	}
+
+	// names are interned once per program
+	symbol::id sym(std::uint32_t name)
+	{
+		auto& s = symbols_[name];
+		if (s == symbol::none) s = symbol::intern(v_.text(v_.names[name]));
+		return s;
+	}
+
+	View v_;
+	std::shared_ptr<Arena> arena_;
+	std::vector<symbol::id> symbols_;
+};
+
+}
+
+inline Program flatten(ast::Program const& program)
+{
+	Program out;
+	out.root = detail::flattener(out).stmts(token::LBRACE, program.statements);
+	return out;
+}
+
+// the pointer tree of a flat program, for the evaluator
+inline std::unique_ptr<ast::Program> unflatten(View v)
+{
+	return detail::unflattener(v).program();
+}
+
+}
+
+}
+
+}
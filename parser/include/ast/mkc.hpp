@@ -0,0 +1,229 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "flat.hpp"
+
+// .mkc, a compiled program: the arrays of a flat::Program behind a header,
+// in the byte order of the machine which wrote it.
+//
+//   header
+//   integers  int64[integers]
+//   a, b      uint32[nodes] each
+//   children  uint32[children]
+//   names     Text[names]
+//   kinds     uint8[nodes]
+//   tokens    uint8[nodes]
+//   chars     char[chars]
+//
+// Every section starts aligned for its type, so a mapping of the file is
+// read in place.
+namespace ast::mkc {
+
+inline constexpr char magic[4] = {'M', 'K', 'C', 0};
+// bump on any change of the layout, of flat::Kind or of token::TokenType
+inline constexpr std::uint32_t version = 1;
+
+struct Header {
+	char magic[4];
+	// also tells a file of the other byte order
+	std::uint32_t version;
+	// of the source, see hash()
+	std::uint64_t source_hash;
+	std::uint32_t nodes;
+	std::uint32_t children;
+	std::uint32_t integers;
+	std::uint32_t names;
+	std::uint32_t chars;
+	std::uint32_t root;
+};
+static_assert(sizeof(Header) % alignof(std::int64_t) == 0);
+
+// FNV-1a
+inline std::uint64_t hash(std::string_view s) noexcept
+{
+	std::uint64_t h = 0xcbf29ce484222325ull;
+	for (unsigned char c: s) {
+		h ^= c;
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+inline bool is_compiled(std::string_view bytes) noexcept
+{
+	return bytes.size() >= sizeof(magic) && std::memcmp(bytes.data(), magic, sizeof(magic)) == 0;
+}
+
+inline std::string write(flat::Program const& p, std::uint64_t source_hash)
+{
+	Header h{};
+	std::memcpy(h.magic, magic, sizeof(magic));
+	h.version = version;
+	h.source_hash = source_hash;
+	h.nodes = p.kinds.size();
+	h.children = p.children.size();
+	h.integers = p.integers.size();
+	h.names = p.names.size();
+	h.chars = p.chars.size();
+	h.root = p.root;
+
+	std::string out;
+	auto put = [&out](auto const& v) {
+		out.append(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(v[0]));
+	};
+	out.append(reinterpret_cast<const char*>(&h), sizeof(h));
+	put(p.integers);
+	put(p.a);
+	put(p.b);
+	put(p.children);
+	put(p.names);
+	put(p.kinds);
+	put(p.tokens);
+	put(p.chars);
+	return out;
+}
+
+namespace detail {
+
+// every reference of a node points to an earlier node, in bounds, of the
+// kind unflatten() expects there. So a corrupt file cannot make a cycle
+// or read out of the arrays.
+inline bool valid(flat::View const& v)
+{
+	using flat::Kind;
+	auto n = static_cast<flat::node>(v.size());
+	auto is_stmt = [&](flat::node c) { return v.kinds[c] <= Kind::block; };
+	auto is_block = [&](flat::node c) { return v.kinds[c] == Kind::block; };
+	auto is_expr = [&](flat::node c) { return v.kinds[c] > Kind::block; };
+	// c is a child of i
+	auto child = [&](flat::node i, flat::node c, auto is, bool optional) {
+		return c == flat::none ? optional : c < i && is(c);
+	};
+	auto text = [&](std::uint64_t offset, std::uint64_t size) { return offset + size <= v.chars.size(); };
+
+	for (auto const& t: v.names)
+		if (!text(t.offset, t.size)) return false;
+	if (v.root >= n || !is_block(v.root)) return false;
+
+	for (flat::node i = 0; i < n; ++i) {
+		if (v.kinds[i] > Kind::hash || token::index(v.tokens[i]) >= token::count) return false;
+		auto a = v.a[i], b = v.b[i];
+		std::span<const flat::node> list;
+		switch (v.kinds[i]) {
+			case Kind::block:
+			case Kind::if_expr:
+			case Kind::function:
+			case Kind::call:
+			case Kind::array:
+			case Kind::hash:
+				if (std::uint64_t(a) + b > v.children.size()) return false;
+				list = v.list(i);
+				break;
+			default:
+				break;
+		}
+		bool ok = true;
+		switch (v.kinds[i]) {
+			case Kind::let:
+				ok = a < v.names.size() && child(i, b, is_expr, true);
+				break;
+			case Kind::ret:
+			case Kind::expr_stmt:
+			case Kind::prefix:
+				ok = child(i, a, is_expr, true);
+				break;
+			case Kind::block:
+				for (auto c: list) ok = ok && child(i, c, is_stmt, false);
+				break;
+			case Kind::ident:
+				ok = a < v.names.size();
+				break;
+			case Kind::integer:
+				ok = a < v.integers.size();
+				break;
+			case Kind::boolean:
+				break;
+			case Kind::string:
+				ok = text(a, b);
+				break;
+			case Kind::infix:
+			case Kind::index:
+				ok = child(i, a, is_expr, true) && child(i, b, is_expr, true);
+				break;
+			case Kind::if_expr:
+				ok = list.size() == 3 && child(i, list[0], is_expr, true) &&
+					child(i, list[1], is_block, true) && child(i, list[2], is_block, true);
+				break;
+			case Kind::function:
+				// parameters..., body
+				ok = !list.empty() && child(i, list.back(), is_block, true);
+				for (std::size_t k = 0; ok && k + 1 < list.size(); ++k)
+					ok = list[k] < i && v.kinds[list[k]] == Kind::ident;
+				break;
+			case Kind::call:
+			case Kind::array:
+			case Kind::hash:
+				for (auto c: list) ok = ok && child(i, c, is_expr, true);
+				if (v.kinds[i] == Kind::call) ok = ok && !list.empty();
+				if (v.kinds[i] == Kind::hash) ok = ok && list.size() % 2 == 0;
+				break;
+		}
+		if (!ok) return false;
+	}
+	return true;
+}
+
+// count Ts at p, then past them
+template<class T>
+std::span<const T> take(const char*& p, std::uint32_t count)
+{
+	std::span<const T> s{reinterpret_cast<const T*>(p), count};
+	p += count * sizeof(T);
+	return s;
+}
+
+}
+
+// the header of a compiled program of this version
+inline std::optional<Header> header(std::string_view bytes)
+{
+	Header h;
+	if (bytes.size() < sizeof(h) || !is_compiled(bytes)) return std::nullopt;
+	std::memcpy(&h, bytes.data(), sizeof(h));
+	if (h.version != version) return std::nullopt;
+	return h;
+}
+
+// the view of a compiled program over bytes, which must outlive it
+inline std::optional<flat::View> read(std::string_view bytes)
+{
+	auto hd = header(bytes);
+	if (!hd) return std::nullopt;
+	auto const& h = *hd;
+
+	std::uint64_t size = sizeof(h) + 8ull * h.integers + 8ull * h.nodes + 4ull * h.children +
+		sizeof(flat::Text) * h.names + 2ull * h.nodes + h.chars;
+	if (size != bytes.size()) return std::nullopt;
+
+	using detail::take;
+	const char* p = bytes.data() + sizeof(h);
+	flat::View v;
+	v.integers = take<std::int64_t>(p, h.integers);
+	v.a = take<std::uint32_t>(p, h.nodes);
+	v.b = take<std::uint32_t>(p, h.nodes);
+	v.children = take<flat::node>(p, h.children);
+	v.names = take<flat::Text>(p, h.names);
+	v.kinds = take<flat::Kind>(p, h.nodes);
+	v.tokens = take<token::TokenType>(p, h.nodes);
+	v.chars = take<char>(p, h.chars);
+	v.root = h.root;
+
+	if (!detail::valid(v)) return std::nullopt;
+	return v;
+}
+
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "lexer/lexer.hpp"
+#include "parser.hpp"
+
+// Parse many sources at once. A parser owns all its state, the parse
+// tables are constant and the symbol table is thread safe, so every source
+// is parsed by its own Parser on one of the workers.
+namespace parser {
+
+struct Source {
+	// a file name, for the errors
+	std::string name;
+	// must outlive the parse, the ast copies what it keeps
+	std::string_view text;
+};
+
+struct Unit {
+	std::string name;
+	std::unique_ptr<ast::Program> program;
+	std::vector<std::string> errors;
+};
+
+// the units in the order of sources, whatever the worker which parsed them.
+// workers == 0 is one per hardware thread. lazy as Parser::lazy().
+inline std::vector<Unit> parse_all(std::span<const Source> sources, unsigned workers = 0, Mode mode = Mode::recursive, bool lazy = false)
+{
+	std::vector<Unit> units(sources.size());
+	std::atomic<std::size_t> next{0};
+	std::exception_ptr failed;
+	std::atomic_flag has_failed = ATOMIC_FLAG_INIT;
+
+	auto work = [&] {
+		// the workers take the next source, so a long one holds up a single worker
+		for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < sources.size(); ) {
+			try {
+				Parser<lexer::Lexer> p(new lexer::Lexer(sources[i].text, lexer::borrow), mode);
+				p.lazy(lazy);
+				auto [program, errors] = p.parse();
+				units[i] = Unit{sources[i].name, std::move(program), std::move(errors)};
+			} catch (...) {
+				if (!has_failed.test_and_set()) failed = std::current_exception();
+			}
+		}
+	};
+
+	if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+	workers = std::min<std::size_t>(workers, sources.size());
+	if (workers <= 1) {
+		work();
+	} else {
+		std::vector<std::jthread> pool;
+		pool.reserve(workers - 1);
+		for (unsigned w = 1; w < workers; ++w) pool.emplace_back(work);
+		work();
+	}
+	if (failed) std::rethrow_exception(failed);
+	return units;
+}
+
+// the errors of every unit, prefixed by its name
+inline std::vector<std::string> errors(std::span<const Unit> units)
+{
+	std::vector<std::string> out;
+	for (auto const& u: units)
+		for (auto const& e: u.errors)
+			out.push_back(u.name + ": " + e);
+	return out;
+}
+
+// one program of the statements of the units, in order. It keeps the
+// arenas of the units alive.
+inline std::unique_ptr<ast::Program> merge(std::vector<Unit>&& units)
+{
+	auto arena = ast::Arena::make();
+	std::size_t n = 0;
+	for (auto const& u: units)
+		if (u.program) n += u.program->statements.size();
+
+	ast::Statements stmts(arena->resource());
+	stmts.reserve(n);
+	for (auto& u: units) {
+		if (!u.program) continue;
+		for (auto& s: u.program->statements) stmts.push_back(std::move(s));
+		// the unit goes first, its statements vector is in its arena
+		auto kept = std::move(u.program->arena_);
+		u.program.reset();
+		arena->keep(std::move(kept));
+	}
+	return std::make_unique<ast::Program>(std::move(arena), std::move(stmts));
+}
+
+}
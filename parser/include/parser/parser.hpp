@@ -1,12 +1,13 @@
 #pragma once
 
+#include <array>
+#include <charconv>
 #include <concepts>
 #include <memory>
-#include <unordered_map>
-#include <functional>
 #include <optional>
 // #include <iostream>
 #include "../ast/ast.hpp"
+#include "lexer/lexer.hpp"
 #include "lexer/token.hpp"
 
 namespace parser {
@@ -16,78 +17,55 @@ concept LEXER = requires {
 	{ T().next_token() } -> std::same_as<token::Token>;
 };
 
-template <LEXER Lexer>
-class Parser {
-public:
-	Parser(Lexer* lx): lx_(lx) 
-	{
-		next_token();
-		next_token();
+// recursive descent uses the C++ stack, one frame per nesting level.
+// iterative keeps the pending constructs in a heap stack instead, so the
+// nesting of the input is only limited by memory.
+enum class Mode {
+	recursive,
+	iterative,
+};
 
-		prefix_parse_fns_.emplace(token::IDENT, [this] {
-				return this->parse_identifier();
-				});
-		prefix_parse_fns_.emplace(token::INT, [this] {
-				return this->parse_integer_literal();
-				});
-		// 
-		// prefix_parse_fns_.emplace(token::SEMICOLON, [this] {
-		//     std::cout << "Parse SEMICOLON\n";
-		//     return nullptr;
-		//     });
-		prefix_parse_fns_.emplace(token::BANG, [this] {
-				return this->parse_prefix_expr();
-				});
-		prefix_parse_fns_.emplace(token::MINUS, [this] {
-				return this->parse_prefix_expr();
-				});
-		prefix_parse_fns_.emplace(token::TRUE, [this] {
-				return this->parse_boolean();
-				});
-		prefix_parse_fns_.emplace(token::FALSE, [this] {
-				return this->parse_boolean();
-				});
-		prefix_parse_fns_.emplace(token::LPAREN, [this] {
-				return this->parse_grouped_expr();
-				});
-		prefix_parse_fns_.emplace(token::IF, [this] {
-				return this->parse_if_expr();
-				});
-		prefix_parse_fns_.emplace(token::FUNCTION, [this] {
-				return this->parse_fn_literal();
-				});
-		prefix_parse_fns_.emplace(token::STRING, [this] {
-				return this->parse_string_literal();
-				});
-		prefix_parse_fns_.emplace(token::LBRACKET, [this] {
-				return this->parse_array_literal();
-				});
-		prefix_parse_fns_.emplace(token::LBRACE, [this] {
-				return this->parse_hashtable_literal();
-				});
+// a lexer which can skip a block without lexing it
+template <class T>
+concept BRACE_MATCHING = LEXER<T> && requires(T& l, token::Token const& t) {
+	{ l.offset(t) } -> std::convertible_to<std::size_t>;
+	{ l.match_brace(0) } -> std::convertible_to<std::size_t>;
+	{ l.source() } -> std::same_as<std::string_view>;
+	l.rewind(0);
+};
 
-		static auto parse_infix_expr = [this](ast::Expression* left) {
-			// cur_token_ is infix operator_
-			auto expr = new ast::InfixExpression{cur_token_, cur_token_.literal, left};
+template <Mode M>
+ast::BlockStmt* parse_body(std::string_view source, ast::Arena& arena, std::string& error);
 
-			auto precedence = t2p(cur_token_.token_type);
-			next_token();
-			expr->right_.reset(parse_expr(precedence));
+template <LEXER Lexer>
+class Parser {
+public:
+	// the parse functions are static tables, constructing a parser only primes the tokens
+	Parser(Mode mode = Mode::recursive): mode_(mode) {}
 
-			return expr;
-		};
+	Parser(Lexer* lx, Mode mode = Mode::recursive): mode_(mode)
+	{
+		reset(lx);
+	}
 
-		for (const auto&[infixOp, _]: t2p_maps)
-			infix_parse_fns_.emplace(infixOp, parse_infix_expr);
+	// lazy bodies: a function literal only matches the braces of its body,
+	// which is parsed by its first call. A syntax error there is then an
+	// error of the call. Only for a BRACE_MATCHING lexer.
+	void lazy(bool on = true) noexcept { lazy_ = on; }
 
-		infix_parse_fns_[token::LPAREN] = [this](ast::Expression* fn) {
-				return this->parse_call_expr(fn);
-				};
-		infix_parse_fns_[token::LBRACKET] = [this](ast::Expression* arr) {
-			return this->parse_index_expr(arr);
-		};
+	// the input is a lazy body and the '}' closing it, where the parse ends
+	// as a block does: an error there is at the '}', as in the eager parse
+	void body(bool on = true) noexcept { body_ = on; }
 
-	} // Parse()
+	// parse another input with this parser, such as the next line of repl
+	void reset(Lexer* lx)
+	{
+		lx_.reset(lx);
+		arena_ = ast::Arena::make();
+		errors_.clear();
+		next_token();
+		next_token();
+	}
 
 	// ast::Program* parse() 
 	std::pair<std::unique_ptr<ast::Program>, std::vector<std::string>>
@@ -97,18 +75,24 @@ public:
 		{
 			return token.token_type == token::END_OF_FILE;
 		};
+		static auto body_pred = [](token::Token const& token) -> bool
+		{
+			return token.token_type == token::RBRACE ||
+				token.token_type == token::END_OF_FILE;
+		};
 		
-		return { std::unique_ptr<ast::Program>{ new ast::Program(get_stmts(pred)) }, errors_ };
+		auto stmts = mode_ == Mode::iterative ? parse_iterative() : body_ ? get_stmts(body_pred) : get_stmts(pred);
+		// the program takes the arena, the next parse needs reset()
+		return { std::unique_ptr<ast::Program>{ new ast::Program(std::move(arena_), std::move(stmts)) }, errors_ };
 	}
 
 private:
 
-	using Pred = std::function<bool(token::Token const&)>;
-
 	// if pred() then exit parse
-	std::vector<ast::StmtPtr> get_stmts(Pred&& pred)
+	template<class Pred>
+	ast::Statements get_stmts(Pred pred)
 	{
-		std::vector<ast::StmtPtr> statements;
+		ast::Statements statements(arena_->resource());
 		while (!pred(cur_token_))
 		{
 			auto stmt = parse_stmt();
@@ -140,18 +124,16 @@ private:
 
 	ast::LetStmt* parse_let_stmt()
 	{
-		auto stmt = new ast::LetStmt();
-		stmt->token_ = cur_token_;
+		auto stmt = make<ast::LetStmt>();
+		stmt->token_ = cur_token_.token_type;
 
 		if (!expect_peek(token::IDENT)) {
-			delete stmt;
 			return nullptr;
 		}
 
-		stmt->name_ = ast::IdentifierPtr{ new ast::Identifier(cur_token_, cur_token_.literal) };
+		stmt->name_ = ast::IdentifierPtr{ make<ast::Identifier>(cur_token_.token_type, cur_symbol()) };
 
 		if (!expect_peek(token::ASSIGN)) {
-			delete stmt;
 			return nullptr;
 		}
 		// cur_token_ '=', to parse_expr for value, next_token()
@@ -168,8 +150,8 @@ private:
 	
 	ast::ReturnStmt* parse_return_stmt()
 	{
-		auto stmt = new ast::ReturnStmt{};
-		stmt->token_ = cur_token_;
+		auto stmt = make<ast::ReturnStmt>();
+		stmt->token_ = cur_token_.token_type;
 		
 		next_token();
 
@@ -186,6 +168,12 @@ private:
 		return stmt;
 	}
 
+	// interned name of the current IDENT, for a lexer which does not intern
+	symbol::id cur_symbol() const
+	{
+		return cur_token_.sym != symbol::none ? cur_token_.sym : symbol::intern(cur_token_.literal);
+	}
+
 	bool cur_token_is(token::TokenType t) const noexcept
 	{
 		return cur_token_.token_type == t;
@@ -213,10 +201,9 @@ private:
 	// due to unknown pragram, errors hold by parser.
 	void peek_error(token::TokenType expected)
 	{
-		std::string err(64, 0);
-		std::sprintf(err.data(), "expected next token to be %s, got %s instead",
-				expected.c_str(), peek_token_.token_type.c_str());
-		errors_.push_back(err);
+		// as long as the message, with no padding after it
+		errors_.push_back("expected next token to be " + std::string(token::name(expected))
+				+ ", got " + std::string(token::name(peek_token_.token_type)) + " instead");
 	}
 
 	enum class Precedence {
@@ -230,30 +217,33 @@ private:
 		index,
 	};
 
-	static inline std::unordered_map<token::TokenType, Precedence> t2p_maps{
+	// TokenType -> Precedence, the tokens not listed are Precedence::lowest
+	static constexpr std::array<Precedence, token::count> t2p_table = [] {
+		std::array<Precedence, token::count> table{};
 		// operator_, such as +, -, *, callback is parse_infix_expr
-		{token::EQ, Precedence::equals},
-		{token::NEQ, Precedence::equals},
-		{token::LT, Precedence::less_greater},
-		{token::GT, Precedence::less_greater},
-		{token::PLUS, Precedence::sum},
-		{token::MINUS, Precedence::sum},
-		{token::SLASH, Precedence::product},
-		{token::ASTERISK, Precedence::product},
+		table[token::index(token::EQ)] = Precedence::equals;
+		table[token::index(token::NEQ)] = Precedence::equals;
+		table[token::index(token::LT)] = Precedence::less_greater;
+		table[token::index(token::GT)] = Precedence::less_greater;
+		table[token::index(token::PLUS)] = Precedence::sum;
+		table[token::index(token::MINUS)] = Precedence::sum;
+		table[token::index(token::SLASH)] = Precedence::product;
+		table[token::index(token::ASTERISK)] = Precedence::product;
 		// '(' for call function, callback is parse_call_expr
-		{token::LPAREN, Precedence::call},
-		{token::LBRACKET, Precedence::index}
-	};
+		table[token::index(token::LPAREN)] = Precedence::call;
+		table[token::index(token::LBRACKET)] = Precedence::index;
+		return table;
+	}();
 
-	static Precedence t2p(token::TokenType t) 
+	static constexpr Precedence t2p(token::TokenType t) noexcept
 	{
-		return t2p_maps.contains(t) ? t2p_maps[t] : Precedence::lowest;
+		return t2p_table[token::index(t)];
 	}
 
 	ast::ExpressionStmt* parse_expr_stmt()
 	{
-		auto* stmt = new ast::ExpressionStmt{};
-		stmt->token_ = cur_token_;
+		auto* stmt = make<ast::ExpressionStmt>();
+		stmt->token_ = cur_token_.token_type;
 		stmt->expression_ = ast::ExpressionPtr{parse_expr(Precedence::lowest)};
 	
 		if (peek_token_is(token::SEMICOLON)) next_token();
@@ -263,53 +253,61 @@ private:
 
 	void no_prefix_fn_error(token::TokenType expected)
 	{
-		std::string err(64, 0);
-		std::sprintf(err.data(), "no prefix parse function for [%s] found", expected.c_str());
-		errors_.push_back(err);
+		errors_.push_back("no prefix parse function for [" + std::string(token::name(expected)) + "] found");
 	}
 
 	ast::Expression* parse_expr(Precedence precedence)
 	{
 		// prefix: IDENT, INT, BANG, MINUS, Boolean
-		auto* expr =  prefix_parse_fns_.contains(cur_token_.token_type) ?
-			prefix_parse_fns_[cur_token_.token_type]() :
-			(no_prefix_fn_error(cur_token_.token_type), nullptr);
+		auto prefix = prefix_parse_fns[token::index(cur_token_.token_type)];
+		auto* expr = prefix ? (this->*prefix)() : (no_prefix_fn_error(cur_token_.token_type), nullptr);
 
 		// in prefix parse, don't call next_token()
 
 		// infix
 		while (!peek_token_is(token::SEMICOLON) && precedence < t2p(peek_token_.token_type)) {
-			if  (!infix_parse_fns_.contains(peek_token_.token_type))
+			auto infix = infix_parse_fns[token::index(peek_token_.token_type)];
+			if (!infix)
 				return expr;
 			next_token();
-			expr = infix_parse_fns_[cur_token_.token_type](expr);
+			expr = (this->*infix)(expr);
 		}
 
 		return expr;
 	}
 
+	ast::Expression* parse_infix_expr(ast::Expression* left)
+	{
+		// cur_token_ is infix operator_
+		auto expr = make<ast::InfixExpression>(cur_token_.token_type, token::spelling(cur_token_.token_type), left);
+
+		auto precedence = t2p(cur_token_.token_type);
+		next_token();
+		expr->right_.reset(parse_expr(precedence));
+
+		return expr;
+	}
+
 	ast::Expression* parse_identifier()
 	{
-		return new ast::Identifier{
-			token::Token{this->cur_token_},
-			this->cur_token_.literal};
+		return make<ast::Identifier>(this->cur_token_.token_type,
+			this->cur_symbol());
 	}
 
 	ast::Expression* parse_integer_literal()
 	{
 		std::int64_t val {};
-		try {
-			val = std::stoll(cur_token_.literal);
-		} catch (std::exception& e) {
-			errors_.emplace_back(e.what());
+		auto const& lit = cur_token_.literal;
+		if (auto [_, ec] = std::from_chars(lit.data(), lit.data() + lit.size(), val); ec != std::errc{}) {
+			errors_.push_back("could not parse " + std::string(lit) + " as integer");
 			return nullptr;
 		}
-		return new ast::IntegerLiteral(cur_token_, val);
+		return make<ast::IntegerLiteral>(cur_token_.token_type, val);
 	}
 
 	ast::Expression* parse_prefix_expr()
 	{
-		auto expr = new ast::PrefixExpression{cur_token_, cur_token_.literal}; 
+		auto expr = make<ast::PrefixExpression>(cur_token_.token_type, token::spelling(cur_token_.token_type)); 
 
 		// skip current prefix operator_
 		next_token();
@@ -323,7 +321,7 @@ private:
 
 	ast::Expression* parse_boolean()
 	{
-		return new ast::Boolean{cur_token_, cur_token_is(token::TRUE)};
+		return make<ast::Boolean>(cur_token_.token_type, cur_token_is(token::TRUE));
 	}
 
 	ast::Expression* parse_grouped_expr()
@@ -333,7 +331,6 @@ private:
 		auto* expr = parse_expr(Precedence::lowest);
 
 		if (!expect_peek(token::RPAREN)) {
-			delete expr;
 			return nullptr;
 		}
 
@@ -342,12 +339,11 @@ private:
 
 	ast::Expression* parse_if_expr()
 	{
-		auto* expr = new ast::IfExpression();
-		expr->token_ = cur_token_;
+		auto* expr = make<ast::IfExpression>();
+		expr->token_ = cur_token_.token_type;
 
 		// expect '('
 		if (!expect_peek(token::LPAREN)) {
-			delete expr;
 			return nullptr;
 		}
 		// cur_token_ is (, skip to the next
@@ -356,12 +352,10 @@ private:
 		expr->cond_.reset(parse_expr(Precedence::lowest));
 
 		if (!expect_peek(token::RPAREN)) {
-			delete expr;
 			return nullptr;
 		}
 
 		if (!expect_peek(token::LBRACE)) {
-			delete expr;
 			return nullptr;
 		}
 
@@ -375,7 +369,6 @@ private:
 		// cur_token_ is 'ELSE'
 
 		if (!expect_peek(token::LBRACE)) {
-			delete expr;
 			return nullptr;
 		}
 
@@ -389,8 +382,7 @@ private:
 
 	ast::BlockStmt* parse_block_stmt()
 	{
-		auto* block = new ast::BlockStmt;
-		block->token_ = cur_token_;
+		auto blockToken = cur_token_.token_type;
 
 		// cur_token_ is '{', to next
 		next_token();
@@ -400,13 +392,11 @@ private:
 			return token.token_type == token::RBRACE ||
 				token.token_type == token::END_OF_FILE;
 		};
-		block->statements_ = get_stmts(pred);
-
-		return block;
+		return make<ast::BlockStmt>(blockToken, get_stmts(pred));
 	}
 
 	ast::Expression* parse_fn_literal() {
-		auto fnToken = cur_token_;
+		auto fnToken = cur_token_.token_type;
 
 		if (!expect_peek(token::LPAREN)) {
 			return nullptr;
@@ -415,7 +405,7 @@ private:
 
 		// auto ops = parse_fn_param();
 		auto ops = parse_list<ast::FunctionLiteral::ParamType>([this]{
-				return new ast::Identifier{cur_token_, cur_token_.literal};
+				return make<ast::Identifier>(cur_token_.token_type, cur_symbol());
 				});
 		if (!ops) {
 			return nullptr;
@@ -426,17 +416,40 @@ private:
 			return nullptr;
 		}
 		// cur_token_ is '{'
+		if (auto* lazy = lazy_fn_literal(fnToken, *ops))
+			return lazy;
 		auto* body = parse_block_stmt();
 
-		return new ast::FunctionLiteral{fnToken, move(*ops), body};
+		return make<ast::FunctionLiteral>(fnToken, std::move(*ops), body, arena_.get());
 		// cur_token_ is '}'
 	}
 
-	using _param = ast::FunctionLiteral::Parameters::element_type;
+	// cur_token_ is the '{' of a body, skip to its '}' if lazy
+	ast::FunctionLiteral* lazy_fn_literal(token::TokenType t, ast::FunctionLiteral::ParamList& ps)
+	{
+		if constexpr (BRACE_MATCHING<Lexer>) {
+			if (!lazy_) return nullptr;
+			auto open = lx_->offset(cur_token_);
+			auto close = lx_->match_brace(open);
+			// unbalanced, the eager parse reports it
+			if (close == std::string_view::npos) return nullptr;
+			// the body and its '}', which outlive the input
+			auto source = arena_->copy(lx_->source().substr(open + 1, close - open));
+			auto parse = mode_ == Mode::iterative ? &parse_body<Mode::iterative> : &parse_body<Mode::recursive>;
+			lx_->rewind(close);
+			peek_token_ = lx_->next_token();
+			next_token();
+			// cur_token_ is '}'
+			return make<ast::FunctionLiteral>(t, std::move(ps), source, parse, arena_.get());
+		}
+		return nullptr;
+	}
+
+	using _param = ast::FunctionLiteral::ParamList;
 	[[deprecated("use parse_list<> instead")]]
 	std::optional<_param> parse_fn_param()
 	{
-		_param ps;
+		_param ps(arena_->resource());
 
 		// void parmeter, not error
 		if (peek_token_is(token::RPAREN)) {
@@ -446,13 +459,13 @@ private:
 		}
 
 		next_token(); // skip '('
-		auto* p = new ast::Identifier{cur_token_, cur_token_.literal};
+		auto* p = make<ast::Identifier>(cur_token_.token_type, cur_symbol());
 		ps.emplace_back(p);
 
 		while (peek_token_is(token::COMMA)) {
 			next_token(); // skip current parameter
 			next_token(); // skip ','
-			auto* p = new ast::Identifier{cur_token_, cur_token_.literal};
+			auto* p = make<ast::Identifier>(cur_token_.token_type, cur_symbol());
 			ps.emplace_back(p);
 		}
 
@@ -466,23 +479,23 @@ private:
 	ast::Expression* parse_call_expr(ast::Expression* fn)
 	{
 		// cur_token_is '(', fn is function
-		auto callToken = cur_token_;
+		auto callToken = cur_token_.token_type;
 		auto args = parse_list<ast::CallExpression::ArgType>([this] {
 				return this->parse_expr(Precedence::lowest);
 				});
 		if (!args)
 			return nullptr;
-		return new ast::CallExpression{callToken, fn, std::move(args.value())};
+		return make<ast::CallExpression>(callToken, fn, std::move(args.value()));
 	}
 
 	// parse parameter list or args list
 	template<typename T>
 	requires std::same_as<T, ast::FunctionLiteral::ParamType> 
 	|| std::same_as<T, ast::CallExpression::ArgType>
-	std::optional<std::vector<std::unique_ptr<T>>>
-	parse_list(std::function<T*()> get_nx, token::TokenType rightEnd = token::RPAREN)
+	std::optional<std::pmr::vector<ast::NodePtr<T>>>
+	parse_list(std::invocable auto get_nx, token::TokenType rightEnd = token::RPAREN)
 	{
-		std::vector<std::unique_ptr<T>> ps;
+		std::pmr::vector<ast::NodePtr<T>> ps(arena_->resource());
 
 		// void parmeter, not error
 		if (peek_token_is(rightEnd)) {
@@ -510,36 +523,36 @@ private:
 	}
 
 	ast::Expression* parse_string_literal() {
-		return new ast::StringLiteral{cur_token_, cur_token_.literal};
+		return make<ast::StringLiteral>(cur_token_.token_type, arena_->copy(cur_token_.literal));
 	}
 
 	ast::Expression* parse_array_literal() {
 		// cur_token_is '[', fn is array
-		auto arrToken = cur_token_;
+		auto arrToken = cur_token_.token_type;
 		auto args = parse_list<ast::ArrayLiteral::ElementType>([this] {
 				return this->parse_expr(Precedence::lowest);
 				}, token::RBRACKET);
 		if (!args)
 			return nullptr;
-		return new ast::ArrayLiteral{arrToken, std::move(args.value())};
+		return make<ast::ArrayLiteral>(arrToken, std::move(args.value()));
 	}
 
 	ast::Expression* parse_index_expr(ast::Expression* arr)
 	{
 		// cur_token_is '[', fn is array
-		auto arrToken = cur_token_;
+		auto arrToken = cur_token_.token_type;
 		next_token();
 		auto* index = parse_expr(Precedence::lowest);
 		if (!expect_peek(token::RBRACKET)) return nullptr;
-		return new ast::IndexExpression{arrToken, arr, index};
+		return make<ast::IndexExpression>(arrToken, arr, index);
 	}
 
 	ast::Expression* parse_hashtable_literal()
 	{
 		// cur_token_is '{'
-		auto hashToken = cur_token_;
+		auto hashToken = cur_token_.token_type;
 
-		std::vector<ast::HashTableLiteral::Pair> pairs;
+		ast::HashTableLiteral::Pairs pairs(arena_->resource());
 		while (!peek_token_is(token::RBRACE)) {
 			next_token();
 			auto key = ast::ExpressionPtr{ parse_expr(Precedence::lowest) };
@@ -556,19 +569,436 @@ private:
 		}
 
 		if (!expect_peek(token::RBRACE)) return nullptr;
-		return new ast::HashTableLiteral{hashToken, std::move(pairs)};
+		return make<ast::HashTableLiteral>(hashToken, std::move(pairs));
+	}
+
+	// A construct of the iterative parser waiting for what is parsed above
+	// it in the stack: an expression (expr frame), a statement or a block.
+	struct Frame {
+		enum Kind: std::uint8_t {
+			program,
+			block,
+			let,
+			ret,
+			expr_stmt,
+			// an expression, its prefix is parsed, then binds the infix ops above precedence
+			expr,
+			prefix,
+			group,
+			infix,
+			call,
+			index,
+			array,
+			hash,
+			hash_key,
+			hash_value,
+			if_cond,
+			if_consequence,
+			if_alternative,
+			function,
+		};
+		Kind kind;
+		Precedence precedence;
+		ast::Node* node;
+		// the key of hash_value
+		ast::Expression* key = nullptr;
+	};
+
+	// the same grammar, errors and ast as the recursive parse functions,
+	// with the recursion replaced by frames
+	ast::Statements parse_iterative()
+	{
+		std::vector<Frame> stack;
+		stack.push_back({Frame::program, Precedence::lowest,
+				make<ast::BlockStmt>(token::LBRACE, ast::Statements(arena_->resource()))});
+
+		enum {
+			block_loop, // the next statement of the top block
+			start_expr, // an expression of precedence, at cur_token_
+			infix_loop, // the infix ops after value, in the top expr frame
+			hash_next, // the next pair of the top hash frame
+			start_block, // a block at '{'
+			deliver_expr, // value to the frame which wants it
+			deliver_stmt, // stmt to the top block
+			deliver_block, // block to the frame which wants it
+		} state = block_loop;
+
+		auto precedence = Precedence::lowest;
+		ast::Expression* value = nullptr;
+		ast::Statement* stmt = nullptr;
+		ast::BlockStmt* block = nullptr;
+
+		auto expect_expr = [&](Frame f, Precedence p) {
+			stack.push_back(f);
+			precedence = p;
+			state = start_expr;
+		};
+		// fail or finish the construct of the top frame, as the prefix of the expr below
+		auto pop_value = [&](ast::Expression* v) {
+			stack.pop_back();
+			value = v;
+			state = infix_loop;
+		};
+
+		for (;;) {
+			switch (state) {
+			case block_loop: {
+				auto& f = stack.back();
+				if (cur_token_is(token::END_OF_FILE) || ((f.kind == Frame::block || body_) && cur_token_is(token::RBRACE))) {
+					block = static_cast<ast::BlockStmt*>(f.node);
+					if (f.kind == Frame::program)
+						return std::move(block->statements_);
+					stack.pop_back();
+					state = deliver_block;
+					break;
+				}
+				if (cur_token_is(token::LET)) {
+					auto* s = make<ast::LetStmt>();
+					s->token_ = cur_token_.token_type;
+					stmt = nullptr;
+					state = deliver_stmt;
+					if (!expect_peek(token::IDENT))
+						break;
+					s->name_ = ast::IdentifierPtr{ make<ast::Identifier>(cur_token_.token_type, cur_symbol()) };
+					if (!expect_peek(token::ASSIGN))
+						break;
+					next_token();
+					expect_expr({Frame::let, Precedence::lowest, s}, Precedence::lowest);
+				} else if (cur_token_is(token::RETURN)) {
+					auto* s = make<ast::ReturnStmt>();
+					s->token_ = cur_token_.token_type;
+					next_token();
+					if (cur_token_is(token::SEMICOLON)) {
+						stmt = s;
+						state = deliver_stmt;
+					} else {
+						expect_expr({Frame::ret, Precedence::lowest, s}, Precedence::lowest);
+					}
+				} else {
+					auto* s = make<ast::ExpressionStmt>();
+					s->token_ = cur_token_.token_type;
+					expect_expr({Frame::expr_stmt, Precedence::lowest, s}, Precedence::lowest);
+				}
+				break;
+			}
+
+			case start_expr: {
+				stack.push_back({Frame::expr, precedence, nullptr});
+				auto t = cur_token_.token_type;
+				state = infix_loop;
+				switch (t) {
+				case token::BANG:
+				case token::MINUS: {
+					auto* e = make<ast::PrefixExpression>(t, token::spelling(t));
+					next_token();
+					expect_expr({Frame::prefix, Precedence::lowest, e}, Precedence::prefix);
+					break;
+				}
+				case token::LPAREN:
+					next_token();
+					expect_expr({Frame::group, Precedence::lowest, nullptr}, Precedence::lowest);
+					break;
+				case token::LBRACKET: {
+					auto* e = make<ast::ArrayLiteral>(t, ast::ArrayLiteral::Elements(arena_->resource()));
+					if (peek_token_is(token::RBRACKET)) {
+						next_token();
+						value = e;
+					} else {
+						next_token();
+						expect_expr({Frame::array, Precedence::lowest, e}, Precedence::lowest);
+					}
+					break;
+				}
+				case token::LBRACE:
+					stack.push_back({Frame::hash, Precedence::lowest,
+							make<ast::HashTableLiteral>(t, ast::HashTableLiteral::Pairs(arena_->resource()))});
+					state = hash_next;
+					break;
+				case token::IF: {
+					auto* e = make<ast::IfExpression>();
+					e->token_ = t;
+					value = nullptr;
+					if (!expect_peek(token::LPAREN))
+						break;
+					next_token();
+					expect_expr({Frame::if_cond, Precedence::lowest, e}, Precedence::lowest);
+					break;
+				}
+				case token::FUNCTION: {
+					value = nullptr;
+					if (!expect_peek(token::LPAREN))
+						break;
+					auto ops = parse_list<ast::FunctionLiteral::ParamType>([this]{
+							return make<ast::Identifier>(cur_token_.token_type, cur_symbol());
+							});
+					if (!ops || !expect_peek(token::LBRACE))
+						break;
+					if ((value = lazy_fn_literal(t, *ops)))
+						break;
+					stack.push_back({Frame::function, Precedence::lowest,
+							make<ast::FunctionLiteral>(t, std::move(*ops), nullptr, arena_.get())});
+					state = start_block;
+					break;
+				}
+				default:
+					// the leaves, which don't recurse
+					auto prefix = prefix_parse_fns[token::index(t)];
+					value = prefix ? (this->*prefix)() : (no_prefix_fn_error(t), nullptr);
+					break;
+				}
+				break;
+			}
+
+			case infix_loop: {
+				auto p = stack.back().precedence;
+				auto infix = infix_parse_fns[token::index(peek_token_.token_type)];
+				if (peek_token_is(token::SEMICOLON) || !(p < t2p(peek_token_.token_type)) || !infix) {
+					stack.pop_back();
+					state = deliver_expr;
+					break;
+				}
+				next_token();
+				auto t = cur_token_.token_type;
+				if (t == token::LPAREN) {
+					auto* e = make<ast::CallExpression>(t, value, ast::CallExpression::Arguments(arena_->resource()));
+					if (peek_token_is(token::RPAREN)) {
+						next_token();
+						value = e;
+					} else {
+						next_token();
+						expect_expr({Frame::call, Precedence::lowest, e}, Precedence::lowest);
+					}
+				} else if (t == token::LBRACKET) {
+					auto* e = make<ast::IndexExpression>(t, value, nullptr);
+					next_token();
+					expect_expr({Frame::index, Precedence::lowest, e}, Precedence::lowest);
+				} else {
+					auto* e = make<ast::InfixExpression>(t, token::spelling(t), value);
+					next_token();
+					expect_expr({Frame::infix, Precedence::lowest, e}, t2p(t));
+				}
+				break;
+			}
+
+			case hash_next: {
+				auto& f = stack.back();
+				if (peek_token_is(token::RBRACE)) {
+					next_token();
+					pop_value(static_cast<ast::Expression*>(f.node));
+				} else {
+					next_token();
+					f.kind = Frame::hash_key;
+					precedence = Precedence::lowest;
+					state = start_expr;
+				}
+				break;
+			}
+
+			case start_block:
+				stack.push_back({Frame::block, Precedence::lowest,
+						make<ast::BlockStmt>(cur_token_.token_type, ast::Statements(arena_->resource()))});
+				next_token();
+				state = block_loop;
+				break;
+
+			case deliver_expr: {
+				auto& f = stack.back();
+				switch (f.kind) {
+				case Frame::prefix: {
+					auto* e = static_cast<ast::PrefixExpression*>(f.node);
+					e->right_.reset(value);
+					pop_value(e);
+					break;
+				}
+				case Frame::group:
+					pop_value(expect_peek(token::RPAREN) ? value : nullptr);
+					break;
+				case Frame::infix: {
+					auto* e = static_cast<ast::InfixExpression*>(f.node);
+					e->right_.reset(value);
+					pop_value(e);
+					break;
+				}
+				case Frame::call:
+				case Frame::array: {
+					auto* e = static_cast<ast::Expression*>(f.node);
+					auto end = f.kind == Frame::call ? token::RPAREN : token::RBRACKET;
+					if (f.kind == Frame::call)
+						static_cast<ast::CallExpression*>(e)->args_.emplace_back(value);
+					else
+						static_cast<ast::ArrayLiteral*>(e)->elements_.emplace_back(value);
+					if (peek_token_is(token::COMMA)) {
+						next_token();
+						next_token();
+						precedence = Precedence::lowest;
+						state = start_expr;
+					} else {
+						pop_value(expect_peek(end) ? e : nullptr);
+					}
+					break;
+				}
+				case Frame::index: {
+					auto* e = static_cast<ast::IndexExpression*>(f.node);
+					e->index_.reset(value);
+					pop_value(expect_peek(token::RBRACKET) ? e : nullptr);
+					break;
+				}
+				case Frame::hash_key:
+					f.key = value;
+					if (!expect_peek(token::COLON)) {
+						pop_value(nullptr);
+						break;
+					}
+					next_token();
+					f.kind = Frame::hash_value;
+					precedence = Precedence::lowest;
+					state = start_expr;
+					break;
+				case Frame::hash_value:
+					static_cast<ast::HashTableLiteral*>(f.node)->pairs_.emplace_back(
+							ast::ExpressionPtr{f.key}, ast::ExpressionPtr{value});
+					f.kind = Frame::hash;
+					state = hash_next;
+					if (!peek_token_is(token::RBRACE) && !expect_peek(token::COMMA))
+						pop_value(nullptr);
+					break;
+				case Frame::if_cond: {
+					auto* e = static_cast<ast::IfExpression*>(f.node);
+					e->cond_.reset(value);
+					if (!expect_peek(token::RPAREN) || !expect_peek(token::LBRACE)) {
+						pop_value(nullptr);
+						break;
+					}
+					f.kind = Frame::if_consequence;
+					state = start_block;
+					break;
+				}
+				case Frame::let:
+				case Frame::ret:
+				case Frame::expr_stmt:
+					if (f.kind == Frame::let)
+						static_cast<ast::LetStmt*>(f.node)->value_.reset(value);
+					else if (f.kind == Frame::ret)
+						static_cast<ast::ReturnStmt*>(f.node)->return_value_.reset(value);
+					else
+						static_cast<ast::ExpressionStmt*>(f.node)->expression_.reset(value);
+					if (peek_token_is(token::SEMICOLON))
+						next_token();
+					stmt = static_cast<ast::Statement*>(f.node);
+					stack.pop_back();
+					state = deliver_stmt;
+					break;
+				default:
+					break;
+				}
+				break;
+			}
+
+			case deliver_stmt:
+				if (stmt)
+					static_cast<ast::BlockStmt*>(stack.back().node)->statements_.emplace_back(stmt);
+				// skip delimiter, such as ';', '}' ...
+				next_token();
+				state = block_loop;
+				break;
+
+			case deliver_block: {
+				auto& f = stack.back();
+				if (f.kind == Frame::function) {
+					auto* e = static_cast<ast::FunctionLiteral*>(f.node);
+					e->body_ = block;
+					pop_value(e);
+				} else if (f.kind == Frame::if_consequence) {
+					auto* e = static_cast<ast::IfExpression*>(f.node);
+					e->consequence_.reset(block);
+					if (!peek_token_is(token::ELSE)) {
+						pop_value(e);
+					} else {
+						next_token();
+						if (!expect_peek(token::LBRACE)) {
+							pop_value(nullptr);
+						} else {
+							f.kind = Frame::if_alternative;
+							state = start_block;
+						}
+					}
+				} else {
+					auto* e = static_cast<ast::IfExpression*>(f.node);
+					e->alternative_.reset(block);
+					pop_value(e);
+				}
+				break;
+			}
+			}
+		}
 	}
 
+	// nodes are allocated in the arena of the program being parsed
+	template<class Node, class... Args>
+	Node* make(Args&&... args)
+	{
+		return arena_->template make<Node>(std::forward<Args>(args)...);
+	}
+
+	Mode mode_ = Mode::recursive;
+	bool lazy_ = false;
+	bool body_ = false;
 	using LexerPtr = std::unique_ptr<Lexer>;
 	LexerPtr lx_;
+	std::shared_ptr<ast::Arena> arena_;
 	token::Token cur_token_;
 	token::Token peek_token_;
 	std::vector<std::string> errors_;
 
-	using prefixParseFn = std::function<ast::Expression*()>; 
-	using infixParseFn = std::function<ast::Expression*(ast::Expression*)>;
-	std::unordered_map<token::TokenType, prefixParseFn> prefix_parse_fns_;
-	std::unordered_map<token::TokenType, infixParseFn> infix_parse_fns_;
+	using prefixParseFn = ast::Expression* (Parser::*)();
+	using infixParseFn = ast::Expression* (Parser::*)(ast::Expression*);
+
+	// indexed by TokenType, nullptr means no parse function
+	static constexpr std::array<prefixParseFn, token::count> prefix_parse_fns = [] {
+		std::array<prefixParseFn, token::count> table{};
+		table[token::index(token::IDENT)] = &Parser::parse_identifier;
+		table[token::index(token::INT)] = &Parser::parse_integer_literal;
+		table[token::index(token::BANG)] = &Parser::parse_prefix_expr;
+		table[token::index(token::MINUS)] = &Parser::parse_prefix_expr;
+		table[token::index(token::TRUE)] = &Parser::parse_boolean;
+		table[token::index(token::FALSE)] = &Parser::parse_boolean;
+		table[token::index(token::LPAREN)] = &Parser::parse_grouped_expr;
+		table[token::index(token::IF)] = &Parser::parse_if_expr;
+		table[token::index(token::FUNCTION)] = &Parser::parse_fn_literal;
+		table[token::index(token::STRING)] = &Parser::parse_string_literal;
+		table[token::index(token::LBRACKET)] = &Parser::parse_array_literal;
+		table[token::index(token::LBRACE)] = &Parser::parse_hashtable_literal;
+		return table;
+	}();
+
+	static constexpr std::array<infixParseFn, token::count> infix_parse_fns = [] {
+		std::array<infixParseFn, token::count> table{};
+		// every operator with a precedence is binary, but for '(' and '['
+		for (std::size_t t = 0; t < token::count; ++t)
+			if (t2p_table[t] != Precedence::lowest)
+				table[t] = &Parser::parse_infix_expr;
+		table[token::index(token::LPAREN)] = &Parser::parse_call_expr;
+		table[token::index(token::LBRACKET)] = &Parser::parse_index_expr;
+		return table;
+	}();
 };
 
+// the body of a lazy function literal, lazy in turn. Its nodes live in an
+// arena of their own, kept by the arena of the literal.
+template <Mode M>
+ast::BlockStmt* parse_body(std::string_view source, ast::Arena& arena, std::string& error)
+{
+	Parser<lexer::Lexer> p(new lexer::Lexer(source, lexer::borrow), M);
+	p.lazy();
+	p.body();
+	auto [program, errors] = p.parse();
+	if (!errors.empty()) {
+		error = errors.front();
+		return nullptr;
+	}
+	auto* body = program->arena_->make<ast::BlockStmt>(token::LBRACE, std::move(program->statements));
+	arena.keep(std::move(program->arena_));
+	return body;
+}
+
 }
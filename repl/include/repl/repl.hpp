@@ -6,14 +6,18 @@
 
 
 struct repl {
+	// the environment, and so the values, live from a line to the next
+	template<class EvalHandler = evaluator::eval_handler>
 	static void start(std::istream& in, std::ostream& out) {
 		auto env = std::make_shared<obj::environment>();
+		parser::Parser<lexer::Lexer> p;
 		for (;;) {
 			std::string input;
 			out << ">> ";
 			// in >> input; BUG: by not only '\n'
 			std::getline(in, input);
-			parser::Parser<lexer::Lexer> p(new lexer::Lexer{input});
+			// the ast copies what it keeps of the line, so the lexer may borrow it
+			p.reset(new lexer::Lexer{input, lexer::borrow});
 			auto [program, errors] = p.parse();
 			if (!errors.empty()) {
 				for (auto const& err: errors) out << err << '\n';
@@ -21,10 +25,10 @@ struct repl {
 			}
 
 			// out << "Program:" << program->to_string() << '\n';
-			auto evaluated = evaluator::eval<evaluator::eval_handler>(program.get(), env);
+			auto evaluated = evaluator::eval<EvalHandler>(program.get(), env);
 			// out << "end of eval\n";
 			if (evaluated) {
-				out << evaluated->inspect() << '\n';
+				out << evaluated.inspect() << '\n';
 			}
 		}
 	}
@@ -0,0 +1,321 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lexer/lexer.hpp"
+#include "lexer/stream_lexer.hpp"
+#include "parser/parser.hpp"
+#include "parser/parallel.hpp"
+#include "ast/mkc.hpp"
+#include "eval/eval.hpp"
+#include "vm/machine.hpp"
+#include "eval/closure.hpp"
+
+// read-only mapping of a whole file, empty if the file cannot be mapped
+class mapped_file {
+public:
+	explicit mapped_file(const char* path)
+	{
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0) return;
+		struct stat st;
+		if (::fstat(fd, &st) == 0) {
+			ok_ = true;
+			size_ = st.st_size;
+			// mmap() refuses an empty length, an empty file is an empty view
+			if (size_ > 0) {
+				addr_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (addr_ == MAP_FAILED) {
+					addr_ = nullptr;
+					ok_ = false;
+				} else {
+					::madvise(addr_, size_, MADV_SEQUENTIAL);
+				}
+			}
+		}
+		::close(fd);
+	}
+
+	mapped_file(mapped_file const&) = delete;
+	mapped_file& operator=(mapped_file const&) = delete;
+
+	~mapped_file()
+	{
+		if (addr_) ::munmap(addr_, size_);
+	}
+
+	explicit operator bool() const noexcept { return ok_; }
+
+	std::string_view view() const noexcept
+	{
+		return addr_ ? std::string_view{static_cast<const char*>(addr_), size_} : std::string_view{};
+	}
+
+private:
+	void* addr_ = nullptr;
+	std::size_t size_ = 0;
+	bool ok_ = false;
+};
+
+// run a whole program, rather than line by line as repl
+struct runner {
+	// exit status, as sysexits.h
+	enum status {
+		ok = 0,
+		usage = 64,
+		parse_error = 65,
+		no_input = 66,
+		runtime_error = 70,
+		cant_create = 73,
+		// not of sysexits.h, a failed differential run of --engine=both
+		engines_differ = 1,
+	};
+
+	enum class engine {
+		// evaluator::eval_handler
+		tree,
+		// vm::machine
+		vm,
+		// evaluator::closure_handler
+		closure,
+		// both, comparing their outputs
+		both,
+	};
+	static inline engine selected = engine::tree;
+
+	// sets engine by name, false for an unknown one
+	static bool use(std::string_view name)
+	{
+		if (name == "tree") selected = engine::tree;
+		else if (name == "vm") selected = engine::vm;
+		else if (name == "closure") selected = engine::closure;
+		else if (name == "both") selected = engine::both;
+		else return false;
+		return true;
+	}
+
+	// the program sees args as an array of strings named `args`.
+	// path is a source or a compiled program. With MONKEY_CACHE set to a
+	// directory, the compiled form of a source is cached there by its hash.
+	// With MONKEY_LAZY set, the function bodies of a source are parsed by
+	// their first call.
+	static int run_file(const char* path, std::vector<std::string> const& args, std::ostream& err)
+	{
+		mapped_file file(path);
+		if (!file) {
+			err << "cannot read " << path << '\n';
+			return no_input;
+		}
+		if (ast::mkc::is_compiled(file.view()))
+			return run_compiled(file.view(), args, err);
+		if (auto dir = std::getenv("MONKEY_CACHE"); dir && *dir)
+			return run_cached(dir, file.view(), args, err);
+		// the mapping outlives the parse, the ast copies what it keeps
+		return run(new lexer::Lexer(file.view(), lexer::borrow), args, err);
+	}
+
+	// the sources at paths as one program, in order, parsed in parallel
+	static int run_files(std::vector<std::string> const& paths, std::vector<std::string> const& args, std::ostream& err)
+	{
+		std::vector<std::unique_ptr<mapped_file>> files;
+		std::vector<parser::Source> sources;
+		for (auto const& path: paths) {
+			auto& f = files.emplace_back(std::make_unique<mapped_file>(path.c_str()));
+			if (!*f) {
+				err << "cannot read " << path << '\n';
+				return no_input;
+			}
+			sources.push_back({path, f->view()});
+		}
+
+		auto units = parser::parse_all(sources, 0, parser::Mode::iterative, lazy());
+		if (auto errors = parser::errors(units); !errors.empty()) {
+			for (auto const& e: errors) err << e << '\n';
+			return parse_error;
+		}
+		return execute(parser::merge(std::move(units)).get(), args, err);
+	}
+
+	// write the compiled program of the source at path to out
+	static int compile(const char* path, const char* out, std::ostream& err)
+	{
+		mapped_file file(path);
+		if (!file) {
+			err << "cannot read " << path << '\n';
+			return no_input;
+		}
+		auto program = parse(new lexer::Lexer(file.view(), lexer::borrow), err);
+		if (!program)
+			return parse_error;
+		if (!write_file(out, ast::mkc::write(ast::flat::flatten(*program), ast::mkc::hash(file.view())))) {
+			err << "cannot write " << out << '\n';
+			return cant_create;
+		}
+		return ok;
+	}
+
+	// read all of in before parsing
+	static int run_all(std::istream& in, std::vector<std::string> const& args, std::ostream& err)
+	{
+		std::string src{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+		return run(new lexer::Lexer(src, lexer::borrow), args, err);
+	}
+
+	// lex fd through a bounded buffer, for the inputs too large to hold
+	static int run_stream(int fd, std::vector<std::string> const& args, std::ostream& err)
+	{
+		return run(new lexer::StreamLexer(fd), args, err);
+	}
+
+private:
+	// a compiled program needs every body, a run only those it calls
+	static bool lazy()
+	{
+		auto on = std::getenv("MONKEY_LAZY");
+		return on && *on && std::string_view(on) != "0";
+	}
+
+	template<parser::LEXER Lexer>
+	static std::unique_ptr<ast::Program> parse(Lexer* lx, std::ostream& err, bool lazy = false)
+	{
+		// generated scripts nest deeper than the C++ stack allows
+		parser::Parser<Lexer> p(lx, parser::Mode::iterative);
+		p.lazy(lazy);
+		auto [program, errors] = p.parse();
+		if (!errors.empty()) {
+			for (auto const& e: errors) err << e.c_str() << '\n';
+			return nullptr;
+		}
+		return std::move(program);
+	}
+
+	template<parser::LEXER Lexer>
+	static int run(Lexer* lx, std::vector<std::string> const& args, std::ostream& err)
+	{
+		auto program = parse(lx, err, lazy());
+		return program ? execute(program.get(), args, err) : parse_error;
+	}
+
+	static int run_compiled(std::string_view bytes, std::vector<std::string> const& args, std::ostream& err)
+	{
+		auto v = ast::mkc::read(bytes);
+		if (!v) {
+			err << "invalid compiled program, or of another version\n";
+			return parse_error;
+		}
+		return execute(ast::flat::unflatten(*v).get(), args, err);
+	}
+
+	static int run_cached(const char* dir, std::string_view src, std::vector<std::string> const& args, std::ostream& err)
+	{
+		auto h = ast::mkc::hash(src);
+		char name[32];
+		std::snprintf(name, sizeof(name), "/%016llx.mkc", static_cast<unsigned long long>(h));
+		auto path = std::string(dir) + name;
+
+		mapped_file cached(path.c_str());
+		if (auto hd = ast::mkc::header(cached.view()); hd && hd->source_hash == h) {
+			if (auto v = ast::mkc::read(cached.view()))
+				return execute(ast::flat::unflatten(*v).get(), args, err);
+		}
+
+		auto program = parse(new lexer::Lexer(src, lexer::borrow), err);
+		if (!program)
+			return parse_error;
+		// a cache which cannot be written is no error
+		write_file(path.c_str(), ast::mkc::write(ast::flat::flatten(*program), h));
+		return execute(program.get(), args, err);
+	}
+
+	// replace path as a whole, a concurrent reader sees the old or the new file
+	static bool write_file(const char* path, std::string const& bytes)
+	{
+		auto tmp = std::string(path) + ".tmp." + std::to_string(::getpid());
+		{
+			std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+			if (!out.write(bytes.data(), bytes.size())) {
+				std::remove(tmp.c_str());
+				return false;
+			}
+		}
+		if (std::rename(tmp.c_str(), path) != 0) {
+			std::remove(tmp.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	static int execute(ast::Program* program, std::vector<std::string> const& args, std::ostream& err)
+	{
+		switch (selected) {
+			case engine::vm: return report(evaluate<vm::machine>(program, args), err);
+			case engine::closure: return report(evaluate<evaluator::closure_handler>(program, args), err);
+			case engine::both: return compare(program, args, err);
+			default: return report(evaluate<evaluator::eval_handler>(program, args), err);
+		}
+	}
+
+	template<class EvalHandler>
+	static obj::Value evaluate(ast::Program* program, std::vector<std::string> const& args)
+	{
+		auto env = std::make_shared<obj::environment>();
+		bind_args(*env, args);
+		auto res = evaluator::eval<EvalHandler>(program, env);
+		env->clear();
+		return res;
+	}
+
+	static int report(obj::Value const& res, std::ostream& err)
+	{
+		if (res && res.type() == obj::ERROR) {
+			err << res.inspect() << '\n';
+			return runtime_error;
+		}
+		return ok;
+	}
+
+	// the differential run: both engines, each printing into a buffer. The
+	// output is printed once, if both printed it and gave the same result.
+	static int compare(ast::Program* program, std::vector<std::string> const& args, std::ostream& err)
+	{
+		std::ostringstream tree_out, vm_out;
+		auto* out = std::cout.rdbuf(tree_out.rdbuf());
+		auto tree = evaluate<evaluator::eval_handler>(program, args);
+		std::cout.rdbuf(vm_out.rdbuf());
+		auto machine = evaluate<vm::machine>(program, args);
+		std::cout.rdbuf(out);
+
+		auto show = [](obj::Value const& r) { return r ? r.inspect() : std::string("nothing"); };
+		if (tree_out.str() != vm_out.str() || show(tree) != show(machine)) {
+			err << "the engines differ\n"
+				"tree: " << show(tree) << "\n" << tree_out.str() <<
+				"vm: " << show(machine) << "\n" << vm_out.str();
+			return engines_differ;
+		}
+		std::cout << vm_out.str();
+		return report(machine, err);
+	}
+
+	static void bind_args(obj::environment& env, std::vector<std::string> const& args)
+	{
+		obj::array::Elements elems;
+		std::string ins = "[";
+		for (auto const& a: args) {
+			if (!elems.empty()) ins += ", ";
+			ins += a;
+			elems.emplace_back(new obj::string{a});
+		}
+		ins += "]";
+		env.set(symbol::intern("args"), obj::Value{new obj::array{std::move(elems), ins}});
+	}
+};
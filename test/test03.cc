@@ -15,16 +15,15 @@ void testAnObejct(std::string const& input)
 		std::cout << "nullptr\n";
 		return;
 	}
-	std::cout << "type: " <<b->type() << ", inspect: " << b->inspect() << '\n';
-	auto i = dynamic_cast<ObjectImpl*>(b.get());
-	if (!i) throw std::runtime_error{"fail: dynamic_cast ObjectImpl"};
+	std::cout << "type: " <<b.type() << ", inspect: " << b.inspect() << '\n';
+	if (b.type() != ObjectImpl::tag) throw std::runtime_error{"fail: type of ObjectImpl"};
 	std::cout << "pass!\n";
 }
 
 void testBoolean()
 {
-	testAnObejct<obj::boolean>("true");
-	testAnObejct<obj::boolean>("false");
+	testAnObejct<obj::tagged<obj::BOOLEAN>>("true");
+	testAnObejct<obj::tagged<obj::BOOLEAN>>("false");
 }
 
 void testBangOp()
@@ -38,7 +37,7 @@ void testBangOp()
 		"!!5",
 	};
 	for (auto input: inputs)
-		testAnObejct<obj::boolean>(input);
+		testAnObejct<obj::tagged<obj::BOOLEAN>>(input);
 }
 
 void testMinuxPrefix()
@@ -84,7 +83,7 @@ void testIntInfix()
 		"(1 > 2) == false",
 	};
 	for (auto input: inputs)
-		testAnObejct<obj::boolean>(input);
+		testAnObejct<obj::tagged<obj::BOOLEAN>>(input);
 }
 
 void testIfElse()
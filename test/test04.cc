@@ -1,8 +1,17 @@
 // for more support test
 #include <iostream>
+#include <sstream>
+#include <thread>
 #include "lexer/lexer.hpp"
+#include "lexer/stream_lexer.hpp"
+#include "ast/flat.hpp"
+#include "ast/mkc.hpp"
 #include "parser/parser.hpp"
+#include "parser/parallel.hpp"
 #include "eval/eval.hpp"
+#include "vm/machine.hpp"
+#include "eval/closure.hpp"
+#include "repl/runner.hpp"
 
 
 void printLexer(std::string const& input)
@@ -23,6 +32,12 @@ void printLexer(std::string const& input)
 	delete l;
 }
 
+[[noreturn]] void fail(std::string const& msg)
+{
+	std::cerr << "Fail: " << msg << '\n';
+	exit(1);
+}
+
 template <typename StmtType>
 void testStmt(std::vector<std::string> const& inputs)
 {
@@ -102,9 +117,8 @@ void testEval(std::string const& input)
 		return;
 	}
 	std::cout << "after eval\n";
-	std::cout << "type: " <<b->type() << ", inspect: " << b->inspect() << '\n';
-	auto i = dynamic_cast<ObjectImpl*>(b.get());
-	if (!i) throw std::runtime_error{"fail: dynamic_cast ObjectImpl: " + b->inspect()};
+	std::cout << "type: " <<b.type() << ", inspect: " << b.inspect() << '\n';
+	if (b.type() != ObjectImpl::tag) fail("type of ObjectImpl: " + b.inspect());
 	std::cout << "pass!\n";
 }
 
@@ -142,7 +156,7 @@ void testString()
 	// testExpr<ast::StringLiteral>(R"a("";)a");
 	// testEval<obj::string>(R"("hello world";)");
 	// testEval<obj::string>(R"("hello" + " " + "world";)");
-	// testEval<obj::boolean>(R"("hello" == "world";)");
+	// testEval<obj::tagged<obj::BOOLEAN>>(R"("hello" == "world";)");
 	// testBuiltin();
 	// testBuiltinError();
 }
@@ -178,8 +192,709 @@ void testHashTable()
 	// )");
 }
 
+void testTokenType()
+{
+	std::vector<std::pair<std::string, std::vector<token::TokenType>>> inputs {
+		{"let x = 5;", {token::LET, token::IDENT, token::ASSIGN, token::INT, token::SEMICOLON}},
+		{"a != b == c", {token::IDENT, token::NEQ, token::IDENT, token::EQ, token::IDENT}},
+		{R"(fn(x) { "s" })", {token::FUNCTION, token::LPAREN, token::IDENT, token::RPAREN,
+			token::LBRACE, token::STRING, token::RBRACE}},
+	};
+
+	for (auto const& [input, expected]: inputs) {
+		lexer::Lexer l(input);
+		for (auto t: expected) {
+			auto actual = l.next_token().token_type;
+			if (actual != t)
+				fail("token: expected " + std::string(token::name(t)) +
+					", got " + std::string(token::name(actual)));
+		}
+		if (l.next_token().token_type != token::END_OF_FILE)
+			fail("token: expected EOF: " + input);
+	}
+	std::cout << "pass!\n";
+}
+
+// lexing is usable in constant expressions
+constexpr std::size_t count_tokens(std::string_view src, token::TokenType type)
+{
+	lexer::Lexer l(src, lexer::borrow);
+	std::size_t n = 0;
+	for (auto t = l.next_token(); t.token_type != token::END_OF_FILE; t = l.next_token())
+		n += t.token_type == type;
+	return n;
+}
+
+static_assert(count_tokens("let f = fn(x) { if (x) { return true; } else { return false; } };", token::RETURN) == 2);
+static_assert(count_tokens("lets iff elsewhere returns fnx truefalse", token::IDENT) == 6);
+static_assert(token::lookup_ident("else") == token::ELSE);
+static_assert(token::lookup_ident("elsa") == token::IDENT);
+
+void testBorrowedLexer()
+{
+	std::string src = R"(let answer = "forty two";)";
+	lexer::Lexer l(src, lexer::borrow);
+	for (auto t = l.next_token(); t.token_type != token::END_OF_FILE; t = l.next_token()) {
+		if (t.literal.data() < src.data() || t.literal.data() + t.literal.size() > src.data() + src.size())
+			fail("literal is not a view of the source: " + std::string(t.literal));
+	}
+
+	parser::Parser<lexer::Lexer> p(new lexer::Lexer(src, lexer::borrow));
+	auto [program, errors] = p.parse();
+	// the ast owns its strings
+	src.assign(src.size(), '#');
+	if (auto s = program->to_string(); s != "let answer = forty two;")
+		fail("ast after the source changed: " + s);
+	std::cout << "pass!\n";
+}
+
+void testParserReset()
+{
+	parser::Parser<lexer::Lexer> p;
+	std::pair<const char*, const char*> lines[] = {
+		{"let x = 1 + 2 * 3;", "let x = (1 + (2 * 3));"},
+		{"let = ;", ""},
+		{"f(a, b)[0] == -x", "((f(a, b)[0]) == (-x))"},
+	};
+	for (auto [in, out]: lines) {
+		p.reset(new lexer::Lexer(in, lexer::borrow));
+		auto [program, errors] = p.parse();
+		// the errors of a line don't leak into the next one
+		if (*out && !errors.empty())
+			fail("errors after reset: " + errors[0]);
+		if (*out && program->to_string() != out)
+			fail("reset parser: " + program->to_string());
+		if (!*out && errors.empty())
+			fail("expected errors for: " + std::string(in));
+	}
+	std::cout << "pass!\n";
+}
+
+// the functions in the globals, and those let in a call, do not keep the
+// arena once the program and the environment are done
+template<class EvalHandler>
+void testArenaFreed(const char* src)
+{
+	std::weak_ptr<ast::Arena> arena;
+	{
+		auto env = std::make_shared<obj::environment>();
+		parser::Parser<lexer::Lexer> p(new lexer::Lexer(src));
+		auto program = p.parse().first;
+		arena = program->arena_;
+		evaluator::eval<EvalHandler>(program.get(), env);
+		env->clear();
+	}
+	{
+		parser::Parser<lexer::Lexer> p(new lexer::Lexer(src));
+		auto program = p.parse().first;
+		if (!arena.expired())
+			fail("arena kept by its environment");
+		arena = program->arena_;
+		evaluator::eval<EvalHandler>(program.get());
+	}
+	if (!arena.expired())
+		fail("arena kept by eval");
+}
+
+void testArenaLifetime()
+{
+	auto env = std::make_shared<obj::environment>();
+	{
+		parser::Parser<lexer::Lexer> p(new lexer::Lexer(R"(let f = fn(x) { x + "!" };)"));
+		auto [program, errors] = p.parse();
+		evaluator::eval<evaluator::eval_handler>(program.get(), env);
+	}
+	// the program and its arena are gone, but f still holds the body
+	parser::Parser<lexer::Lexer> p(new lexer::Lexer(R"(f("bang"))"));
+	auto [program, errors] = p.parse();
+	auto res = evaluator::eval<evaluator::eval_handler>(program.get(), env);
+	if (!res || res.inspect() != "bang!")
+		fail("function after its program: " + (res ? res.inspect() : ""));
+	for (auto src: {"let f = fn(x) { x + 1 }; let g = fn() { f(1) }; g();",
+			"let f = fn() { let g = fn(n) { if (n == 0) { return 0; } g(n - 1) }; g(3) }; f();"}) {
+		testArenaFreed<evaluator::eval_handler>(src);
+		testArenaFreed<vm::machine>(src);
+		testArenaFreed<evaluator::closure_handler>(src);
+	}
+	std::cout << "pass!\n";
+}
+
+void testFlatAst()
+{
+	std::string src = R"(
+		let h = {"one": 1, true: [1, -2, 3 * 4]};
+		let f = fn(x, y) { if (x < y) { return h["one"] + x; } else { !(x == y) } };
+		let g = fn() { return; };
+		f(3, len("four")) + h[true][2];
+	)";
+	parser::Parser<lexer::Lexer> p(new lexer::Lexer(src));
+	auto [program, errors] = p.parse();
+	auto flat = ast::flat::flatten(*program);
+	auto v = flat.view();
+	if (v.kinds[v.root] != ast::flat::Kind::block || v.list(v.root).size() != 4)
+		fail("flat root");
+	if (v.name(v.list(v.root)[1]) != "f")
+		fail("flat name: " + std::string(v.name(v.list(v.root)[1])));
+
+	auto back = ast::flat::unflatten(v);
+	if (back->to_string() != program->to_string())
+		fail("unflatten: " + back->to_string());
+	auto res = evaluator::eval(back.get());
+	if (!res || res.inspect() != "16")
+		fail("eval of unflatten: " + (res ? res.inspect() : ""));
+	std::cout << "pass!\n";
+}
+
+void testIterativeParser()
+{
+	// same ast and same errors as the recursive parser, also for bad input
+	const char* inputs[] = {
+		"let x = 1 + 2 * 3 - -4 / (5 + 6);",
+		"let f = fn(a, b) { if (a < b) { return a; } else { return; } }; f(1, 2)(3)[4];",
+		"let h = {\"a\": [1, 2], 3: fn() { {}; }, true: !false,}; h[\"a\"][0] == len([]);",
+		"if (x) { if (y) { z } } else { let a = fn(x) { x }(1); }",
+		"let = 5; let x 5; return; } + ; fn(x { x }; if x { y }",
+		"{1: 2 3: 4}; [1, 2; (1 + 2; f(1, 2; a[1;",
+		"-(1 + (2 * (3 - (4 / -5)))) != !true",
+	};
+	for (auto in: inputs) {
+		parser::Parser<lexer::Lexer> rec(new lexer::Lexer(in));
+		parser::Parser<lexer::Lexer> it(new lexer::Lexer(in), parser::Mode::iterative);
+		auto [p1, e1] = rec.parse();
+		auto [p2, e2] = it.parse();
+		if (e1 != e2)
+			fail("iterative errors differ for: " + std::string(in));
+		if (e1.empty() && p1->to_string() != p2->to_string())
+			fail("iterative ast: " + p2->to_string());
+	}
+
+	// nesting far beyond the C++ stack
+	std::string deep = std::string(200000, '-') + "1;" + std::string(100000, '(') + "x" + std::string(100000, ')');
+	for (int i = 0; i < 50000; ++i) deep += "if (x) { ";
+	deep += std::string(50000, '}');
+	parser::Parser<lexer::Lexer> p(new lexer::Lexer(deep), parser::Mode::iterative);
+	auto [program, errors] = p.parse();
+	if (!errors.empty() || program->statements.size() != 3)
+		fail("deep nesting: " + (errors.empty() ? "" : errors[0]));
+	std::cout << "pass!\n";
+}
+
+void testScanKernels()
+{
+	using namespace lexer::scan;
+	// runs of every class, with stops at every offset of a vector
+	std::string buf;
+	for (int len = 0; len < 70; ++len) {
+		buf += std::string(len, ' ') + "x" + std::string(len, 'a') + "Z_9" + std::string(len, '7') + "-";
+		buf += std::string(len, 's') + "\"" + std::string(len, '\t') + '\0' + "\xff";
+	}
+	auto* end = buf.data() + buf.size();
+	for (auto* k: {sse2(), avx2(), &active()}) {
+		if (!k) continue;
+		for (auto* p = buf.data(); p != end; ++p) {
+			if (k->skip_space(p, end) != skip(p, end, space) ||
+					k->skip_letters(p, end) != skip(p, end, letter) ||
+					k->skip_digits(p, end) != skip(p, end, digit) ||
+					k->skip_string_body(p, end) != skip(p, end, string_body))
+				fail(std::string("scan kernel: ") + k->name);
+		}
+	}
+	std::cout << "pass!\n";
+}
+
+void testStreamLexer()
+{
+	std::string src = R"(let add = fn(first, second) {
+		first + second;
+	};
+	let s = "a string which is longer than the buffer";
+	if (add(12345, 678) != 13023) { return false; } else { add(1, 2) == 3 }
+	$ { "k": [1, 2] }["k"][0] ")";
+
+	// every buffer size must give the same tokens as Lexer
+	for (std::size_t capacity: {1, 2, 3, 5, 7, 64, 4096}) {
+		std::istringstream in(src);
+		lexer::StreamLexer sl(in, capacity);
+		lexer::Lexer l(src);
+		for (;;) {
+			auto expected = l.next_token();
+			auto actual = sl.next_token();
+			if (actual.token_type != expected.token_type || actual.literal != expected.literal)
+				fail("stream lexer: expected " + std::string(expected.literal) +
+					", got " + std::string(actual.literal));
+			if (expected.token_type == token::END_OF_FILE) break;
+		}
+	}
+
+	// multi-line program through the parser and evaluator
+	std::istringstream in(R"(
+	let fib = fn(n) {
+		if (n < 2) { return n; } else {
+			fib(n - 1) + fib(n - 2)
+		}
+	};
+	fib(15);
+	)");
+	parser::Parser<lexer::StreamLexer> p(new lexer::StreamLexer(in, 8));
+	auto [program, errors] = p.parse();
+	if (!errors.empty())
+		fail("stream lexer: parse error: " + errors[0]);
+	auto res = evaluator::eval(program.get());
+	if (res.inspect() != "610")
+		fail("stream lexer: fib(15) = " + res.inspect());
+	std::cout << "pass!\n";
+}
+
+void testRunner()
+{
+	struct { std::string src; int status; } cases[] {
+		{"let f = fn(x) { if (x > 1) { x } }; f(0); len(args);", runner::ok},
+		{"let x = ;", runner::parse_error},
+		{"1 + \"one\";", runner::runtime_error},
+	};
+	for (auto const& [src, status]: cases) {
+		std::istringstream in(src);
+		std::ostringstream err;
+		if (auto s = runner::run_all(in, {"arg"}, err); s != status)
+			fail("runner: " + src + " exit " + std::to_string(s) + err.str());
+	}
+	std::cout << "pass!\n";
+}
+
+void testCompiled()
+{
+	std::string src = R"(let f = fn(a, b) { if (a < b) { return [a, "b", {true: b}]; } }; f(1, 2)[2][true] + len(args);)";
+	parser::Parser<lexer::Lexer> p(new lexer::Lexer(src));
+	auto [program, errors] = p.parse();
+	auto bytes = ast::mkc::write(ast::flat::flatten(*program), ast::mkc::hash(src));
+
+	// the read view is in place, over the bytes
+	auto v = ast::mkc::read(bytes);
+	if (!v || v->chars.data() < bytes.data() || v->chars.data() >= bytes.data() + bytes.size())
+		fail("read compiled program");
+	if (auto back = ast::flat::unflatten(*v); back->to_string() != program->to_string())
+		fail("compiled program: " + back->to_string());
+
+	// any damage is refused, rather than read out of bounds
+	for (std::size_t i = sizeof(ast::mkc::Header); i < bytes.size(); ++i) {
+		auto bad = bytes;
+		bad[i] ^= 0x80;
+		if (auto bv = ast::mkc::read(bad))
+			ast::flat::unflatten(*bv);
+	}
+	if (ast::mkc::read(bytes.substr(0, bytes.size() - 1)))
+		fail("truncated compiled program");
+	std::cout << "pass!\n";
+}
+
+void testParallelParse()
+{
+	// identifiers are letters only
+	auto var = [](int i) { return std::string("v") + char('a' + i / 26) + char('a' + i % 26); };
+	std::vector<std::string> texts;
+	std::vector<parser::Source> sources;
+	texts.push_back("let " + var(0) + " = 0;");
+	for (int i = 1; i < 64; ++i)
+		texts.push_back("let " + var(i) + " = " + var(i - 1) + " + " + std::to_string(i) + "; let f = fn(a) { a * 2 };");
+	texts[17] = "let = 1;";
+	for (std::size_t i = 0; i < texts.size(); ++i)
+		sources.push_back({"f" + std::to_string(i) + ".mk", texts[i]});
+
+	auto units = parser::parse_all(sources, 4);
+	auto errors = parser::errors(units);
+	if (errors.empty() || units[17].errors.size() != errors.size() || errors[0].rfind("f17.mk: ", 0) != 0)
+		fail("errors of parallel parse");
+
+	texts[17] = "let " + var(17) + " = " + var(16) + " + 17;";
+	sources[17].text = texts[17];
+	units = parser::parse_all(sources, 4);
+	if (!parser::errors(units).empty())
+		fail("parallel parse: " + parser::errors(units)[0]);
+	for (std::size_t i = 0; i < units.size(); ++i)
+		if (units[i].name != sources[i].name)
+			fail("order of parallel parse");
+	auto program = parser::merge(std::move(units));
+	units.clear();
+	// each file uses the one before, and the arenas of the units are alive
+	auto env = std::make_shared<obj::environment>();
+	evaluator::eval<evaluator::eval_handler>(program.get(), env);
+	auto [x, ok] = env->get(symbol::intern(var(63)));
+	if (!ok || x.inspect() != std::to_string(63 * 64 / 2) || program->statements.size() != 126)
+		fail("merged program: " + (ok ? x.inspect() : ""));
+	std::cout << "pass!\n";
+}
+
+void testSymbols()
+{
+	auto a = symbol::intern("some_name");
+	if (a == symbol::none || symbol::intern(std::string("some_") + "name") != a || symbol::name(a) != "some_name")
+		fail("symbol: intern");
+
+	// every thread sees the same ids
+	std::vector<std::vector<symbol::id>> ids(4);
+	std::vector<std::thread> threads;
+	for (auto& v: ids)
+		threads.emplace_back([&v] {
+			for (int i = 0; i < 1000; ++i) v.push_back(symbol::intern("t" + std::to_string(i % 300)));
+		});
+	for (auto& t: threads) t.join();
+	for (auto const& v: ids)
+		if (v != ids[0]) fail("symbol: threads");
+
+	lexer::Lexer l("let x = x;");
+	l.next_token();
+	auto x1 = l.next_token(), assign = l.next_token(), x2 = l.next_token();
+	if (x1.sym != x2.sym || x1.sym != symbol::intern("x") || assign.sym != symbol::none)
+		fail("symbol: lexer");
+	std::cout << "pass!\n";
+}
+
+void testLazyBodies()
+{
+	// the same results as parsing eagerly, in both modes
+	const char* inputs[] = {
+		"let add = fn(x) { fn(y) { x + y } }; add(2)(3);",
+		"let f = fn(s) { let h = {\"}\": s, \"{\": 2}; h[\"}\"] }; f(\"{{\");",
+		"let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) }; fib(15);",
+		"let g = fn() { fn() { fn() { [1, fn(a) { a }(2)] } } }; g()()();",
+		"fn(x) { if (x) { {}; x } else { -x } };",
+	};
+	for (auto in: inputs) {
+		for (auto mode: {parser::Mode::recursive, parser::Mode::iterative}) {
+			parser::Parser<lexer::Lexer> eager(new lexer::Lexer(in), mode);
+			parser::Parser<lexer::Lexer> lazy(new lexer::Lexer(in), mode);
+			lazy.lazy();
+			auto [p1, e1] = eager.parse();
+			auto [p2, e2] = lazy.parse();
+			auto r1 = evaluator::eval(p1.get()), r2 = evaluator::eval(p2.get());
+			if (!e1.empty() || !e2.empty() || r1.inspect() != r2.inspect())
+				fail("lazy: " + r2.inspect() + " for: " + in);
+		}
+	}
+
+	// a body is parsed by its first call, once for all the closures
+	parser::Parser<lexer::Lexer> p(new lexer::Lexer("fn(x) { x * 2 };"));
+	p.lazy();
+	auto program = p.parse().first;
+	auto* stmt = dynamic_cast<ast::ExpressionStmt*>(program->statements[0].get());
+	auto* f = dynamic_cast<ast::FunctionLiteral*>(stmt->expression_.get());
+	if (!f || f->parsed())
+		fail("lazy: body parsed eagerly");
+	auto body = f->body();
+	if (!f->parsed() || body.get() != f->body().get() || f->to_string() != "fn(x) {(x * 2) }")
+		fail("lazy: body " + f->to_string());
+
+	// a syntax error in a body is an error of its call
+	parser::Parser<lexer::Lexer> bad(new lexer::Lexer("let f = fn(x) { x + }; let g = fn() { 1 }; g();"));
+	bad.lazy();
+	auto [bp, be] = bad.parse();
+	auto env = std::make_shared<obj::environment>();
+	auto r = evaluator::eval(bp.get(), env);
+	if (!be.empty() || r.inspect() != "1")
+		fail("lazy: unused bad body");
+	parser::Parser<lexer::Lexer> call(new lexer::Lexer("f(1);"));
+	r = evaluator::eval(call.parse().first.get(), env);
+	// with the error of the eager parse
+	parser::Parser<lexer::Lexer> eager(new lexer::Lexer("let f = fn(x) { x + };"));
+	auto eager_error = eager.parse().second.at(0);
+	if (r.type() != obj::ERROR || r.inspect() != "syntax error: " + eager_error
+			|| eager_error != "no prefix parse function for [}] found")
+		fail("lazy: bad body called: " + r.inspect());
+	parser::Parser<lexer::Lexer> iterative(new lexer::Lexer("fn(x) { x + }(1);"), parser::Mode::iterative);
+	iterative.lazy();
+	auto [ip, ie] = iterative.parse();
+	r = evaluator::eval(ip.get());
+	if (!ie.empty() || r.inspect() != "syntax error: " + eager_error)
+		fail("lazy: bad body called, iterative: " + r.inspect());
+	// and it prints as written
+	parser::Parser<lexer::Lexer> print(new lexer::Lexer("f;"));
+	r = evaluator::eval(print.parse().first.get(), env);
+	if (r.inspect() != "fn(x) { x + }")
+		fail("lazy: bad body printed: " + r.inspect());
+	std::cout << "pass!\n";
+}
+
+void testFunctionInspect()
+{
+	// a function value prints its literal, rendered once for all its closures
+	parser::Parser<lexer::Lexer> p(new lexer::Lexer("let mk = fn(x) { fn(y) { x + y } }; [mk(1), mk(2)];"));
+	auto program = p.parse().first;
+	auto arr = evaluator::eval(program.get());
+	auto const& elems = *static_cast<obj::array*>(arr.get())->elements_;
+	using func = obj::function<ast::FunctionLiteral, obj::environment>;
+	auto* a = dynamic_cast<func*>(elems[0].get());
+	auto* b = dynamic_cast<func*>(elems[1].get());
+	if (!a || !b || a->fn_ != b->fn_ || a->inspect() != "fn(y) {(x + y) }" || b->inspect() != a->inspect())
+		fail("function inspect: " + elems[0].inspect());
+	if (a->fn_->text().data() != b->fn_->text().data())
+		fail("function inspect: rendered twice");
+	std::cout << "pass!\n";
+}
+
+void testOperators()
+{
+	// the operators are resolved by the parser, the spelling stays for printing
+	parser::Parser<lexer::Lexer> p(new lexer::Lexer("-a != b;"));
+	auto program = p.parse().first;
+	auto* stmt = static_cast<ast::ExpressionStmt*>(program->statements[0].get());
+	auto* ie = static_cast<ast::InfixExpression*>(stmt->expression_.get());
+	auto* pe = static_cast<ast::PrefixExpression*>(ie->left_.get());
+	if (ie->op_ != ast::Op::neq || pe->op_ != ast::Op::minus || ie->to_string() != "((-a) != b)")
+		fail("operators: " + ie->to_string());
+
+	std::vector<std::pair<std::string, std::string>> cases {
+		{"7 / 2 * 3 - 1;", "8"},
+		{"1 < 2 != 2 > 1;", "false"},
+		{"-(3 + 4);", "-7"},
+		{"!5;", "false"},
+		{"!!false;", "false"},
+		{"\"a\" + \"b\" == \"ab\";", "true"},
+		{"true == !false;", "true"},
+		{"[] == [];", "false"},
+		{"\"a\" != \"b\";", "unknown operator: a != b"},
+		{"-true;", "unknown operator: - true"},
+		{"1 + true;", "type mismatch: 1 + true"},
+	};
+	for (auto const& [input, want]: cases) {
+		parser::Parser<lexer::Lexer> q(new lexer::Lexer(input));
+		auto r = evaluator::eval(q.parse().first.get());
+		if (r.inspect() != want)
+			fail("operators: " + input + " -> " + r.inspect());
+	}
+	std::cout << "pass!\n";
+}
+
+void testResolver()
+{
+	// a let anywhere in a function is its slot, after the parameters
+	parser::Parser<lexer::Lexer> p(new lexer::Lexer("let f = fn(a) { if (a) { let b = a; } fn() { b + len(a) } };"));
+	auto program = p.parse().first;
+	auto env = std::make_shared<obj::environment>();
+	evaluator::eval(program.get(), env);
+	auto* let = static_cast<ast::LetStmt*>(program->statements[0].get());
+	auto* f = static_cast<ast::FunctionLiteral*>(let->value_.get());
+	auto* stmt = static_cast<ast::ExpressionStmt*>(f->block()->statements_[1].get());
+	auto* inner = static_cast<ast::FunctionLiteral*>(stmt->expression_.get());
+	auto* sum = static_cast<ast::InfixExpression*>(static_cast<ast::ExpressionStmt*>(inner->block()->statements_[0].get())->expression_.get());
+	auto* b = static_cast<ast::Identifier*>(sum->left_.get());
+	auto* call = static_cast<ast::CallExpression*>(sum->right_.get());
+	auto* len = static_cast<ast::Identifier*>(call->fn_.get());
+	auto* a = static_cast<ast::Identifier*>(call->args_[0].get());
+	if (let->name_->addr_.scope != ast::Address::global || f->frame_size_ != 2 || inner->frame_size_ != 0
+			|| b->addr_.scope != ast::Address::local || b->addr_.depth != 1 || b->addr_.slot != 1
+			|| a->addr_.slot != 0 || len->addr_.scope != ast::Address::builtin)
+		fail("resolver: addresses");
+
+	// a name missing at top level fails before anything runs, one in a
+	// function is a global looked up by its call
+	std::vector<std::pair<std::string, std::string>> cases {
+		{"let g = fn() { h() }; let h = fn() { 1 }; g();", "1"},
+		{"let k = fn() { fn() { x } }; k()();", "identifier not defined: x"},
+		{"println(1); x;", "identifier not defined: x"},
+		{"let m = fn() { let y = z; let z = 1; y }; m();", "identifier not defined: z"},
+		{"let x = 1; let n = fn() { let y = x; let x = 2; [y, x] }; n()[0] + n()[1];", "3"},
+		{"let r = fn() { let f = fn(n) { if (n < 1) { 0 } else { n + f(n - 1) } }; f(3) }; r();", "6"},
+		{"let len = fn(x) { 0 }; len(\"abc\");", "0"},
+		// while the slot of a let is unset, the name is the one around
+		{"let x = 1; let f = fn() { if (false) { let x = 2; } x }; f();", "1"},
+		{"let x = 1; let f = fn() { if (true) { let x = 2; } x }; f();", "2"},
+		{"let x = 1; let f = fn() { let g = fn() { x }; let a = g(); let x = 2; let b = g(); a * 10 + b }; f();", "12"},
+		{"let f = fn(len) { fn() { if (false) { let len = 0; } len } }; f(5)();", "5"},
+	};
+	for (auto const& [input, want]: cases) {
+		parser::Parser<lexer::Lexer> q(new lexer::Lexer(input));
+		auto program = q.parse().first;
+		auto tree = evaluator::eval(program.get());
+		auto machine = evaluator::eval<vm::machine>(program.get());
+		auto closure = evaluator::eval<evaluator::closure_handler>(program.get());
+		if (tree.inspect() != want || machine.inspect() != want || closure.inspect() != want)
+			fail("resolver: " + input + " -> " + tree.inspect()
+				+ ", vm " + machine.inspect() + ", closure " + closure.inspect());
+	}
+
+	// as the repl, programs sharing an environment: a function may call a
+	// global let by a later one
+	auto shared = std::make_shared<obj::environment>();
+	std::string got;
+	for (auto const* line: {"let g = fn(x) { h(x) };", "let h = fn(x) { x + 5 };", "g(1);"}) {
+		parser::Parser<lexer::Lexer> q(new lexer::Lexer(line));
+		auto r = evaluator::eval(q.parse().first.get(), shared);
+		got += r ? r.inspect() : std::string("nothing");
+	}
+	if (got.substr(got.size() - 1) != "6" || got.find("not defined") != std::string::npos)
+		fail("resolver: repl " + got);
+
+	// a lazy body resolves at its first call, in the scopes around it
+	parser::Parser<lexer::Lexer> lazy(new lexer::Lexer("let mk = fn(x) { fn(y) { x * y } }; mk(6)(7);"));
+	lazy.lazy();
+	auto r = evaluator::eval(lazy.parse().first.get());
+	if (r.inspect() != "42")
+		fail("resolver: lazy " + r.inspect());
+	std::cout << "pass!\n";
+}
+
+void testSharedValues()
+{
+	// a read and a call share the value of the variable, nothing is cloned
+	parser::Parser<lexer::Lexer> p(new lexer::Lexer("let s = \"text\"; let id = fn(x) { x }; [s, id(s), id];"));
+	auto env = std::make_shared<obj::environment>();
+	auto arr = evaluator::eval(p.parse().first.get(), env);
+	auto const& elems = *static_cast<obj::array*>(arr.get())->elements_;
+	auto [s, ok] = env->get(symbol::intern("s"));
+	auto [id, _] = env->get(symbol::intern("id"));
+	if (!ok || elems[0].get() != s.get() || elems[1].get() != s.get() || elems[2].get() != id.get())
+		fail("shared values: " + arr.inspect());
+	obj::Value one{new obj::string{"one"}};
+	auto copy = one;
+	if (one.unique() || copy.get() != one.get())
+		fail("shared values: count");
+	copy.reset();
+	if (!one.unique())
+		fail("shared values: count");
+	std::cout << "pass!\n";
+}
+
+template<class EvalHandler>
+void testTemporaries()
+{
+	// a temporary is the result, a shared value stays as it is
+	parser::Parser<lexer::Lexer> p(new lexer::Lexer(
+			"let s = \"a\"; let t = s + \"b\" + \"c\"; let u = \"x\" + (t + \"y\"); let id = fn(x) { x + \"\" };"
+			"let big = 4611686018427387903 + 1; [s, t, u, id(s), big, -big, -(big + 1), big + 1 - 1, big];"));
+	auto r = evaluator::eval<EvalHandler>(p.parse().first.get());
+	auto const& elems = *static_cast<obj::array*>(r.get())->elements_;
+	std::string got;
+	for (auto const& e: elems) got += e.inspect() + " ";
+	if (got != "a abc xabcy a 4611686018427387904 -4611686018427387904 -4611686018427387905 4611686018427387904 4611686018427387904 ")
+		fail("temporaries: " + got);
+	std::cout << "pass!\n";
+}
+
+template<class EvalHandler>
+void testLiterals()
+{
+	// a literal evaluated again is the same value, never changed
+	parser::Parser<lexer::Lexer> p(new lexer::Lexer(
+			"let s = fn() { \"s\" }; let a = fn() { [1, \"a\", true] }; let h = fn() { {\"k\": 1, 2: false} };"
+			"let cat = fn() { \"a\" + \"b\" }; let x = a(); let y = append(x, 2);"
+			"let one = s(); let two = s(); let b = a(); let g = h(); let c = cat(); let d = cat(); let k = h();"
+			"[one, two, len(x), len(b), g == k, g[\"k\"], g[2], c, d, x == b];"));
+	auto r = evaluator::eval<EvalHandler>(p.parse().first.get());
+	auto const& elems = *static_cast<obj::array*>(r.get())->elements_;
+	std::string got;
+	for (auto const& e: elems) got += e.inspect() + " ";
+	if (got != "s s 4 3 true 1 false ab ab false " || elems[0].get() != elems[1].get())
+		fail("literals: " + got);
+	std::cout << "pass!\n";
+}
+
+void testValues()
+{
+	// integers, booleans and nil are immediate, without an object
+	auto big = std::int64_t{1} << 62;
+	for (std::int64_t i: {std::int64_t{0}, std::int64_t{-1}, big - 1, -big, big, -big - 1, INT64_MAX, INT64_MIN}) {
+		auto v = obj::Value::integer(i);
+		if (v.type() != obj::INTEGER || v.as_int() != i || v.inspect() != std::to_string(i) || !v.get() != (i >= -big && i < big))
+			fail("values: integer " + std::to_string(i));
+	}
+	auto t = obj::Value::boolean(true), n = obj::Value::nil();
+	if (t.type() != obj::BOOLEAN || !t.as_bool() || t.get() || t.inspect() != "true" || n.type() != obj::NIL
+			|| n.inspect() != "null" || n == obj::Value::boolean(false) || n == obj::Value{})
+		fail("values: immediates");
+
+	// a boxed integer is the same key as an immediate one
+	obj::hashtable::HashTable ht;
+	ht.emplace(obj::Value::integer(big), obj::Value::boolean(true));
+	ht.emplace(obj::Value::integer(7), obj::Value::nil());
+	if (!ht.contains(obj::Value::integer(big)) || !ht.contains(obj::Value::integer(7)) || ht.contains(obj::Value::integer(8)))
+		fail("values: hash");
+
+	parser::Parser<lexer::Lexer> p(new lexer::Lexer("let f = fn(n) { if (n < 1) { return 0; } n + f(n - 1) }; [f(100), 4611686018427387903 + 1];"));
+	auto r = evaluator::eval(p.parse().first.get());
+	if (r.inspect() != "[f(100), (4611686018427387903 + 1)]")
+		fail("values: " + r.inspect());
+	auto const& elems = *static_cast<obj::array*>(r.get())->elements_;
+	if (elems[0].as_int() != 5050 || elems[1].as_int() != big || !elems[1].get())
+		fail("values: " + elems[0].inspect() + " " + elems[1].inspect());
+	std::cout << "pass!\n";
+}
+
+void testEngines()
+{
+	// the vm and the closure compiled handler give the results of the tree walker
+	std::vector<std::string> programs {
+		"let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) }; fib(15);",
+		"let adder = fn(x) { fn(y) { x + y } }; let addtwo = adder(2); [addtwo(3), adder(10)(-4)];",
+		"let f = fn(a, b) { if (a < b) { return [a, \"b\", {true: b}]; } }; f(1, 2)[2][true] + len(args);",
+		"let h = {\"one\": 1, 2: \"two\", true: [3]}; [h[\"one\"], h[2], h[true][0], h[false]];",
+		"let a = append([1, 2], 3); let s = \"x\" + \"y\"; [len(a), a[2], s, s == \"xy\", !s];",
+		"let f = fn() { let x = if (true) { let y = 4; y * 2 }; x }; f();",
+		"if (1 > 2) { 10 } else { if (false) { 1 } };",
+		"let x = 1; return x + 1; x;",
+		"let f = fn(x) { x }; [f == f, [] == [], 1 == 1, -3 / 2, 7 - 2 * 3];",
+		"let f = fn() { 1 + true }; f();",
+		"let f = fn() { let y = z; let z = 1; y }; f();",
+		"5(1);",
+		"[1, 2][5];",
+		"[1, 2][\"0\"];",
+		"{[]: 1}[[]];",
+		"let f = fn(x, y) { y }; f(1);",
+		"len(1, 2);",
+		"let f = fn() {}; f;",
+		"let f = fn(x) {}; [f(1)];",
+		"println(fn(x) {}(1));",
+	};
+	auto show = [](obj::Value const& r) { return r ? r.inspect() : std::string("nothing"); };
+	for (auto const& src: programs) {
+		parser::Parser<lexer::Lexer> p(new lexer::Lexer(src));
+		auto program = p.parse().first;
+		auto tree = evaluator::eval<evaluator::eval_handler>(program.get());
+		auto machine = evaluator::eval<vm::machine>(program.get());
+		if (show(tree) != show(machine))
+			fail("engines: " + src + " tree " + show(tree) + " vm " + show(machine));
+		auto closure = evaluator::eval<evaluator::closure_handler>(program.get());
+		if (show(tree) != show(closure))
+			fail("engines: " + src + " tree " + show(tree) + " closure " + show(closure));
+	}
+
+	// the differential runner
+	runner::use("both");
+	std::istringstream in("let f = fn(x) { println(x); x * 2 }; f(21); println(fn(x) {}(1));");
+	std::ostringstream err;
+	auto status = runner::run_all(in, {}, err);
+	runner::use("tree");
+	if (status != runner::ok)
+		fail("engines: differential run " + err.str());
+	std::cout << "pass!\n";
+}
+
 int main()
 {
+	testLiterals<evaluator::eval_handler>();
+	testLiterals<vm::machine>();
+	testLiterals<evaluator::closure_handler>();
+	testTemporaries<evaluator::eval_handler>();
+	testTemporaries<vm::machine>();
+	testTemporaries<evaluator::closure_handler>();
+	testValues();
+	testEngines();
+	testSharedValues();
+	testResolver();
+	testOperators();
+	testFunctionInspect();
+	testLazyBodies();
+	testCompiled();
+	testParallelParse();
+	testSymbols();
+	testRunner();
+	testStreamLexer();
+	testParserReset();
+	testArenaLifetime();
+	testFlatAst();
+	testIterativeParser();
+	testScanKernels();
+	testTokenType();
+	testBorrowedLexer();
 	testHashTable();
 	return 0;
 }